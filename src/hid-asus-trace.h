@@ -0,0 +1,49 @@
+/*
+ * Tracepoints for the Asus HID driver
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hid_asus
+
+#if !defined(_HID_ASUS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HID_ASUS_TRACE_H
+
+#include <linux/hid.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(asus_report_input,
+	TP_PROTO(struct hid_device *hdev, u8 contacts, bool button),
+
+	TP_ARGS(hdev, contacts, button),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&hdev->dev))
+		__field(u8, contacts)
+		__field(bool, button)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&hdev->dev));
+		__entry->contacts = contacts;
+		__entry->button = button;
+	),
+
+	TP_printk("%s contacts=0x%02x button=%d", __get_str(name),
+		  __entry->contacts, __entry->button)
+);
+
+#endif /* _HID_ASUS_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hid-asus-trace
+
+#include <trace/define_trace.h>
@@ -29,9 +29,14 @@
 #include <linux/hid.h>
 #include <linux/module.h>
 #include <linux/input/mt.h>
+#include <linux/percpu.h>
+#include <linux/version.h>
 
 #include "hid-ids.h"
 
+#define CREATE_TRACE_POINTS
+#include "hid-asus-trace.h"
+
 MODULE_AUTHOR("Yusuke Fujimaki <usk.fujimaki@gmail.com>");
 MODULE_AUTHOR("Brendan McGrath <redmcg@redmandi.dyndns.org>");
 MODULE_AUTHOR("Victor Vlasenko <victor.vlasenko@sysgears.com>");
@@ -53,6 +58,7 @@ MODULE_DESCRIPTION("Asus HID Keyboard and TouchPad");
 #define CONTACT_DATA_SIZE 5
 
 #define BTN_LEFT_MASK 0x01
+#define CONTACT_DOWN_MASK 0xf8
 #define CONTACT_TOOL_TYPE_MASK 0x80
 #define CONTACT_X_MSB_MASK 0xf0
 #define CONTACT_Y_MSB_MASK 0x0f
@@ -72,9 +78,20 @@ MODULE_DESCRIPTION("Asus HID Keyboard and TouchPad");
 
 #define TRKID_SGN       ((TRKID_MAX + 1) >> 1)
 
+static bool timestamp;
+module_param(timestamp, bool, 0444);
+MODULE_PARM_DESC(timestamp, "report MSC_TIMESTAMP with the sample time of each touchpad frame");
+
+/* touchpad counters, summed over all CPUs when read through sysfs */
+struct asus_stats {
+	u64 frames;		/* touchpad frames decoded */
+	u64 bad_size;		/* touchpad reports of the wrong size */
+};
+
 struct asus_drvdata {
 	unsigned long quirks;
 	struct input_dev *input;
+	struct asus_stats __percpu *stats;
 };
 
 static void asus_report_contact_down(struct input_dev *input,
@@ -128,6 +145,24 @@ static void asus_report_tool_width(struct input_dev *input)
 	}
 }
 
+/*
+ * MSC_TIMESTAMP is in microseconds and wraps. Transport drivers such as
+ * i2c-hid set the event timestamp to the hard interrupt time, which is
+ * when the device sampled the frame, not when we got to decode it.
+ */
+static void asus_report_timestamp(struct input_dev *input)
+{
+	ktime_t time;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0)
+	time = input_get_timestamp(input)[INPUT_CLK_MONO];
+#else
+	time = ktime_get();
+#endif
+
+	input_event(input, EV_MSC, MSC_TIMESTAMP, (u32)ktime_to_us(time));
+}
+
 static void asus_report_input(struct input_dev *input, u8 *data)
 {
 	int i;
@@ -151,6 +186,8 @@ static void asus_report_input(struct input_dev *input, u8 *data)
 	asus_report_tool_width(input);
 
 	input_mt_sync_frame(input);
+	if (timestamp)
+		asus_report_timestamp(input);
 	input_sync(input);
 }
 
@@ -160,15 +197,59 @@ static int asus_raw_event(struct hid_device *hdev,
 	struct asus_drvdata *drvdata = hid_get_drvdata(hdev);
 
 	if (drvdata->quirks & QUIRK_IS_MULTITOUCH &&
-					 data[0] == INPUT_REPORT_ID &&
-						size == INPUT_REPORT_SIZE) {
+					 data[0] == INPUT_REPORT_ID) {
+		if (size != INPUT_REPORT_SIZE) {
+			this_cpu_inc(drvdata->stats->bad_size);
+			return 0;
+		}
+
+		trace_asus_report_input(hdev, (data[1] & CONTACT_DOWN_MASK) >> 3,
+					data[1] & BTN_LEFT_MASK);
 		asus_report_input(drvdata->input, data);
+		this_cpu_inc(drvdata->stats->frames);
 		return 1;
 	}
 
 	return 0;
 }
 
+static u64 asus_stat_sum(struct asus_drvdata *drvdata, size_t offset)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(u64 *)((u8 *)per_cpu_ptr(drvdata->stats, cpu) + offset);
+
+	return sum;
+}
+
+#define ASUS_STAT_ATTR(_field)						\
+static ssize_t asus_show_##_field(struct device *dev,			\
+		struct device_attribute *attr, char *buf)		\
+{									\
+	struct hid_device *hdev = to_hid_device(dev);			\
+									\
+	return sprintf(buf, "%llu\n", asus_stat_sum(hid_get_drvdata(hdev), \
+			offsetof(struct asus_stats, _field)));		\
+}									\
+static struct device_attribute dev_attr_stat_##_field =		\
+	__ATTR(_field, 0444, asus_show_##_field, NULL)
+
+ASUS_STAT_ATTR(frames);
+ASUS_STAT_ATTR(bad_size);
+
+static struct attribute *asus_stats_attrs[] = {
+	&dev_attr_stat_frames.attr,
+	&dev_attr_stat_bad_size.attr,
+	NULL
+};
+
+static const struct attribute_group asus_stats_group = {
+	.name	= "asus_stats",
+	.attrs	= asus_stats_attrs,
+};
+
 static int asus_input_configured(struct hid_device *hdev, struct hid_input *hi)
 {
 	struct input_dev *input = hi->input;
@@ -186,6 +267,9 @@ static int asus_input_configured(struct hid_device *hdev, struct hid_input *hi)
 		__set_bit(BTN_LEFT, input->keybit);
 		__set_bit(INPUT_PROP_BUTTONPAD, input->propbit);
 
+		if (timestamp)
+			input_set_capability(input, EV_MSC, MSC_TIMESTAMP);
+
 		ret = input_mt_init_slots(input, MAX_CONTACTS, INPUT_MT_POINTER);
 
 		if (ret) {
@@ -266,6 +350,10 @@ static int asus_probe(struct hid_device *hdev, const struct hid_device_id *id)
 
 	drvdata->quirks = id->driver_data;
 
+	drvdata->stats = devm_alloc_percpu(&hdev->dev, struct asus_stats);
+	if (!drvdata->stats)
+		return -ENOMEM;
+
 	if (drvdata->quirks & QUIRK_NO_INIT_REPORTS)
 		hdev->quirks |= HID_QUIRK_NO_INIT_REPORTS;
 
@@ -297,6 +385,10 @@ static int asus_probe(struct hid_device *hdev, const struct hid_device_id *id)
 		ret = asus_start_multitouch(hdev);
 		if (ret)
 			goto err_stop_hw;
+
+		ret = sysfs_create_group(&hdev->dev.kobj, &asus_stats_group);
+		if (ret)
+			goto err_stop_hw;
 	}
 
 	return 0;
@@ -305,6 +397,16 @@ err_stop_hw:
 	return ret;
 }
 
+static void asus_remove(struct hid_device *hdev)
+{
+	struct asus_drvdata *drvdata = hid_get_drvdata(hdev);
+
+	if (drvdata->quirks & QUIRK_IS_MULTITOUCH)
+		sysfs_remove_group(&hdev->dev.kobj, &asus_stats_group);
+
+	hid_hw_stop(hdev);
+}
+
 static __u8 *asus_report_fixup(struct hid_device *hdev, __u8 *rdesc,
 		unsigned int *rsize)
 {
@@ -332,6 +434,7 @@ static struct hid_driver asus_driver = {
 	.id_table		= asus_devices,
 	.report_fixup		= asus_report_fixup,
 	.probe                  = asus_probe,
+	.remove                 = asus_remove,
 	.input_mapping          = asus_input_mapping,
 	.input_configured       = asus_input_configured,
 #ifdef CONFIG_PM
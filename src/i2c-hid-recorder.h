@@ -0,0 +1,46 @@
+/*
+ * Binary format of the i2c-hid input report flight recorder
+ *
+ * The recorder is a ring of fixed size slots following a small header,
+ * exported as /sys/kernel/debug/i2c_hid/<device>/recorder. The file can be
+ * read or mmap()ed, this header is shared with the userspace tools.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef I2C_HID_RECORDER_H
+#define I2C_HID_RECORDER_H
+
+#include <linux/types.h>
+
+#define I2C_HID_REC_MAGIC	0x52444849	/* "IHDR" */
+#define I2C_HID_REC_VERSION	1
+
+/* bytes of each report kept, enough for every Asus touchpad frame */
+#define I2C_HID_REC_DATA_SIZE	46
+
+struct i2c_hid_rec_header {
+	__u32 magic;
+	__u16 version;
+	__u16 slot_size;	/* sizeof(struct i2c_hid_rec_slot) */
+	__u32 nr_slots;		/* always a power of two */
+	__u32 reserved;
+	__u64 head;		/* number of reports recorded so far */
+	__u8 pad[40];
+};
+
+/*
+ * Record number n lives in slot n % nr_slots. Its seq is n + 1, written
+ * after the rest of the slot, so a reader can tell a slot that was
+ * overwritten or is being written by comparing seq before and after copying.
+ */
+struct i2c_hid_rec_slot {
+	__u64 seq;
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC, end of the I2C read */
+	__u16 len;		/* report length, without the length prefix */
+	__u8 data[I2C_HID_REC_DATA_SIZE];
+};
+
+#endif /* I2C_HID_RECORDER_H */
@@ -0,0 +1,623 @@
+/*
+ * Simulated HID over I2C device for i2c-hid testing and benchmarking
+ *
+ * Registers a software I2C adapter with a single HID over I2C slave that
+ * looks like the Asus FTE100x touchpad. The slave serves the HID and
+ * report descriptors, signals reset completion, handles GET/SET_REPORT
+ * and SET_POWER, and streams multitouch frames at a configurable rate
+ * through a simulated interrupt, so the whole i2c_hid_probe -> hid-asus
+ * -> input pipeline can run without hardware.
+ *
+ * Needs a kernel with CONFIG_IRQ_SIM. Build with:
+ *   make -C /lib/modules/$(uname -r)/build M=$PWD/src CONFIG_I2C_HID_SIM=m
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/irqdomain.h>
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+#include <linux/i2c/i2c-hid.h>
+#else
+#include <linux/platform_data/i2c-hid.h>
+#endif
+
+#include "hid-ids.h"
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+#error "i2c-hid-sim needs the irq_sim interface (kernel 4.19 or later)"
+#endif
+
+/* register map served by the simulated device */
+#define SIM_REG_HID_DESC	0x0001
+#define SIM_REG_REPORT_DESC	0x0002
+#define SIM_REG_INPUT		0x0003
+#define SIM_REG_OUTPUT		0x0004
+#define SIM_REG_COMMAND		0x0005
+#define SIM_REG_DATA		0x0006
+
+#define SIM_OP_RESET		0x01
+#define SIM_OP_GET_REPORT	0x02
+#define SIM_OP_SET_REPORT	0x03
+#define SIM_OP_SET_POWER	0x08
+
+#define SIM_PWR_ON		0x00
+
+#define SIM_FEATURE_REPORT_ID	0x0d
+#define SIM_FEATURE_SIZE	4
+#define SIM_INPUT_REPORT_ID	0x5d
+#define SIM_INPUT_REPORT_SIZE	28
+#define SIM_INPUT_LENGTH	(SIM_INPUT_REPORT_SIZE + 2)
+
+#define SIM_MAX_CONTACTS	5
+#define SIM_MAX_X		2794
+#define SIM_MAX_Y		1758
+
+#define SIM_QUEUE_LEN		16
+
+static unsigned int rate_hz = 140;
+module_param(rate_hz, uint, 0644);
+MODULE_PARM_DESC(rate_hz, "input reports per second, 0 stops the stream");
+
+static unsigned int contacts = 2;
+module_param(contacts, uint, 0644);
+MODULE_PARM_DESC(contacts, "number of contacts in each report (0-5)");
+
+static unsigned int bus_khz;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "emulated bus clock for transfer time, 0 = instant");
+
+static unsigned int bus_delay_us;
+module_param(bus_delay_us, uint, 0644);
+MODULE_PARM_DESC(bus_delay_us, "fixed latency added to every transfer");
+
+static unsigned int reset_delay_ms = 1;
+module_param(reset_delay_ms, uint, 0644);
+MODULE_PARM_DESC(reset_delay_ms, "delay before signalling reset completion");
+
+static const u8 sim_rdesc[] = {
+	0x05, 0x01,			/* Usage Page (Generic Desktop)	*/
+	0x09, 0x02,			/* Usage (Mouse)		*/
+	0xa1, 0x01,			/* Collection (Application)	*/
+	0x06, 0x00, 0xff,		/*  Usage Page (Vendor 0xff00)	*/
+	0x85, SIM_INPUT_REPORT_ID,	/*  Report ID (0x5d)		*/
+	0x09, 0x01,			/*  Usage (0x01)		*/
+	0x15, 0x00,			/*  Logical Minimum (0)		*/
+	0x26, 0xff, 0x00,		/*  Logical Maximum (255)	*/
+	0x75, 0x08,			/*  Report Size (8)		*/
+	0x95, SIM_INPUT_REPORT_SIZE - 1, /* Report Count (27)	*/
+	0x81, 0x02,			/*  Input (Data,Var,Abs)	*/
+	0x85, SIM_FEATURE_REPORT_ID,	/*  Report ID (0x0d)		*/
+	0x09, 0x02,			/*  Usage (0x02)		*/
+	0x95, SIM_FEATURE_SIZE,		/*  Report Count (4)		*/
+	0xb1, 0x02,			/*  Feature (Data,Var,Abs)	*/
+	0xc0,				/* End Collection		*/
+};
+
+/* same layout as struct i2c_hid_desc in i2c-hid.c */
+static const __le16 sim_hdesc[15] = {
+	cpu_to_le16(30),			/* wHIDDescLength */
+	cpu_to_le16(0x0100),			/* bcdVersion */
+	cpu_to_le16(sizeof(sim_rdesc)),		/* wReportDescLength */
+	cpu_to_le16(SIM_REG_REPORT_DESC),	/* wReportDescRegister */
+	cpu_to_le16(SIM_REG_INPUT),		/* wInputRegister */
+	cpu_to_le16(SIM_INPUT_LENGTH),		/* wMaxInputLength */
+	cpu_to_le16(SIM_REG_OUTPUT),		/* wOutputRegister */
+	cpu_to_le16(0),				/* wMaxOutputLength */
+	cpu_to_le16(SIM_REG_COMMAND),		/* wCommandRegister */
+	cpu_to_le16(SIM_REG_DATA),		/* wDataRegister */
+	cpu_to_le16(USB_VENDOR_ID_ASUSTEK),	/* wVendorID */
+	cpu_to_le16(USB_DEVICE_ID_ASUSTEK_TOUCHPAD), /* wProductID */
+	cpu_to_le16(0x0100),			/* wVersionID */
+	0, 0,					/* reserved */
+};
+
+static struct i2c_hid_platform_data sim_pdata = {
+	.hid_descriptor_address = SIM_REG_HID_DESC,
+};
+
+enum sim_event {
+	SIM_EV_CREATED,
+	SIM_EV_HID_DESC,
+	SIM_EV_RESET,
+	SIM_EV_REPORT_DESC,
+	SIM_EV_MT_ENABLED,
+	SIM_EV_POWER_ON,
+	SIM_EV_RESUMED,
+	SIM_EV_MAX
+};
+
+static const char * const sim_event_names[SIM_EV_MAX] = {
+	[SIM_EV_CREATED]	= "created",
+	[SIM_EV_HID_DESC]	= "hid_desc",
+	[SIM_EV_RESET]		= "reset",
+	[SIM_EV_REPORT_DESC]	= "report_desc",
+	[SIM_EV_MT_ENABLED]	= "mt_enabled",
+	[SIM_EV_POWER_ON]	= "power_on",
+	[SIM_EV_RESUMED]	= "resumed",
+};
+
+struct i2c_hid_sim {
+	struct i2c_adapter	adap;
+	struct i2c_client	*client;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,11,0)
+	struct irq_sim		irq_sim;
+#else
+	struct irq_domain	*irq_domain;
+#endif
+	int			irq;
+
+	spinlock_t		lock;		/* protects everything below */
+	u8			queue[SIM_QUEUE_LEN][SIM_INPUT_LENGTH];
+	unsigned int		head;
+	unsigned int		tail;
+	bool			reset_pending;
+	bool			powered;
+	bool			mt_enabled;
+	u8			feature[SIM_FEATURE_SIZE];
+	unsigned long		frame;
+
+	struct hrtimer		stream_timer;
+	struct hrtimer		reset_timer;
+
+	ktime_t			events[SIM_EV_MAX];
+	ktime_t			last_power_on;
+	u64			resume_ns;
+	u64			generated;
+	u64			delivered;
+	u64			overflows;
+	u64			empty_reads;
+	u64			transfers;
+	u64			bytes;
+
+	struct dentry		*debugfs;
+};
+
+static struct i2c_hid_sim *sim;
+
+static void sim_fire_irq(struct i2c_hid_sim *s)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,11,0)
+	irq_sim_fire(&s->irq_sim, 0);
+#else
+	irq_set_irqchip_state(s->irq, IRQCHIP_STATE_PENDING, true);
+#endif
+}
+
+static void sim_event(struct i2c_hid_sim *s, enum sim_event ev)
+{
+	s->events[ev] = ktime_get();
+}
+
+static unsigned int sim_queue_len(struct i2c_hid_sim *s)
+{
+	return s->head - s->tail;
+}
+
+static void sim_build_frame(struct i2c_hid_sim *s, u8 *buf)
+{
+	unsigned int n = min_t(unsigned int, contacts, SIM_MAX_CONTACTS);
+	u8 *c = buf + 4;
+	unsigned int i;
+
+	memset(buf, 0, SIM_INPUT_LENGTH);
+	buf[0] = SIM_INPUT_LENGTH & 0xff;
+	buf[1] = SIM_INPUT_LENGTH >> 8;
+	buf[2] = SIM_INPUT_REPORT_ID;
+
+	for (i = 0; i < n; i++) {
+		int x = (SIM_MAX_X / (n + 1)) * (i + 1);
+		int y = (s->frame * 4 + i * 200) % SIM_MAX_Y;
+
+		buf[3] |= BIT(i + 3);
+		c[0] = ((x >> 4) & 0xf0) | ((y >> 8) & 0x0f);
+		c[1] = x & 0xff;
+		c[2] = y & 0xff;
+		c[3] = 3 << 4;
+		c[4] = 48;
+		c += 5;
+	}
+
+	s->frame++;
+}
+
+static enum hrtimer_restart sim_stream_timer(struct hrtimer *timer)
+{
+	struct i2c_hid_sim *s = container_of(timer, struct i2c_hid_sim,
+					     stream_timer);
+	unsigned int rate = READ_ONCE(rate_hz);
+	unsigned long flags;
+	bool fire = false;
+
+	spin_lock_irqsave(&s->lock, flags);
+	if (s->powered && s->mt_enabled && rate) {
+		if (sim_queue_len(s) < SIM_QUEUE_LEN) {
+			sim_build_frame(s, s->queue[s->head % SIM_QUEUE_LEN]);
+			s->head++;
+			s->generated++;
+		} else {
+			s->overflows++;
+		}
+	}
+	/*
+	 * The interrupt line stays asserted while reports are pending. A
+	 * pending edge is dropped while the driver's oneshot handler keeps the
+	 * line masked, so raise it again on every tick until they are read.
+	 */
+	fire = s->reset_pending || (s->powered && sim_queue_len(s));
+	spin_unlock_irqrestore(&s->lock, flags);
+
+	if (fire)
+		sim_fire_irq(s);
+
+	hrtimer_forward_now(timer, ns_to_ktime(NSEC_PER_SEC / max(rate, 1U)));
+	return HRTIMER_RESTART;
+}
+
+static enum hrtimer_restart sim_reset_timer(struct hrtimer *timer)
+{
+	struct i2c_hid_sim *s = container_of(timer, struct i2c_hid_sim,
+					     reset_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&s->lock, flags);
+	s->reset_pending = true;
+	s->mt_enabled = false;
+	s->head = s->tail = 0;
+	sim_event(s, SIM_EV_RESET);
+	spin_unlock_irqrestore(&s->lock, flags);
+
+	sim_fire_irq(s);
+	return HRTIMER_NORESTART;
+}
+
+static void sim_bus_delay(struct i2c_msg *msgs, int num)
+{
+	unsigned int khz = READ_ONCE(bus_khz);
+	u64 ns = (u64)READ_ONCE(bus_delay_us) * NSEC_PER_USEC;
+	unsigned int bytes = 0;
+	int i;
+
+	if (khz) {
+		/* address byte + payload, 9 clocks per byte */
+		for (i = 0; i < num; i++)
+			bytes += msgs[i].len + 1;
+		ns += div_u64((u64)bytes * 9 * NSEC_PER_MSEC, khz);
+	}
+
+	if (ns)
+		usleep_range(div_u64(ns, NSEC_PER_USEC),
+			     div_u64(ns, NSEC_PER_USEC) + 1);
+}
+
+/* called with s->lock held */
+static void sim_read_input(struct i2c_hid_sim *s, u8 *buf, u16 len)
+{
+	memset(buf, 0, len);
+
+	if (s->reset_pending) {
+		/* a zero length report signals reset completion */
+		s->reset_pending = false;
+		return;
+	}
+
+	if (!sim_queue_len(s)) {
+		s->empty_reads++;
+		return;
+	}
+
+	memcpy(buf, s->queue[s->tail % SIM_QUEUE_LEN],
+	       min_t(u16, len, SIM_INPUT_LENGTH));
+	s->tail++;
+	s->delivered++;
+}
+
+/* called with s->lock held */
+static void sim_command(struct i2c_hid_sim *s, const u8 *buf, u16 len)
+{
+	u8 report_id, opcode;
+	unsigned int idx = 4;
+
+	if (len < 4)
+		return;
+
+	report_id = buf[2] & 0x0f;
+	opcode = buf[3] & 0x0f;
+
+	switch (opcode) {
+	case SIM_OP_RESET:
+		hrtimer_start(&s->reset_timer, ms_to_ktime(reset_delay_ms),
+			      HRTIMER_MODE_REL);
+		break;
+	case SIM_OP_SET_POWER:
+		s->powered = report_id == SIM_PWR_ON;
+		if (s->powered) {
+			s->last_power_on = ktime_get();
+			sim_event(s, SIM_EV_POWER_ON);
+		}
+		break;
+	case SIM_OP_SET_REPORT:
+		if (report_id == 0x0f && len > idx)
+			report_id = buf[idx++];
+		/* data register, size, report ID, payload */
+		idx += 2 + 2 + 1;
+		if (report_id != SIM_FEATURE_REPORT_ID || len < idx)
+			break;
+		memcpy(s->feature, buf + idx,
+		       min_t(unsigned int, len - idx, SIM_FEATURE_SIZE));
+		s->mt_enabled = true;
+		if (!s->events[SIM_EV_MT_ENABLED]) {
+			sim_event(s, SIM_EV_MT_ENABLED);
+			break;
+		}
+		/* any later enable comes from reset_resume */
+		sim_event(s, SIM_EV_RESUMED);
+		s->resume_ns = ktime_to_ns(ktime_sub(s->events[SIM_EV_RESUMED],
+						     s->last_power_on));
+		break;
+	}
+}
+
+/* called with s->lock held */
+static void sim_register_read(struct i2c_hid_sim *s, const u8 *cmd, u16 cmd_len,
+			      u8 *buf, u16 len)
+{
+	u16 reg = cmd[0] | cmd[1] << 8;
+	u8 report_id, size;
+
+	memset(buf, 0, len);
+
+	switch (reg) {
+	case SIM_REG_HID_DESC:
+		memcpy(buf, sim_hdesc, min_t(u16, len, sizeof(sim_hdesc)));
+		sim_event(s, SIM_EV_HID_DESC);
+		break;
+	case SIM_REG_REPORT_DESC:
+		memcpy(buf, sim_rdesc, min_t(u16, len, sizeof(sim_rdesc)));
+		sim_event(s, SIM_EV_REPORT_DESC);
+		break;
+	case SIM_REG_INPUT:
+		sim_read_input(s, buf, len);
+		break;
+	case SIM_REG_COMMAND:
+		if (cmd_len < 4 || (cmd[3] & 0x0f) != SIM_OP_GET_REPORT)
+			break;
+		report_id = cmd[2] & 0x0f;
+		if (report_id == 0x0f && cmd_len > 4)
+			report_id = cmd[4];
+		if (report_id != SIM_FEATURE_REPORT_ID)
+			break;
+		size = 2 + 1 + SIM_FEATURE_SIZE;
+		if (len < 3)
+			break;
+		buf[0] = size;
+		buf[2] = report_id;
+		memcpy(buf + 3, s->feature,
+		       min_t(unsigned int, len - 3, SIM_FEATURE_SIZE));
+		break;
+	}
+}
+
+static int sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct i2c_hid_sim *s = i2c_get_adapdata(adap);
+	unsigned long flags;
+	int i;
+
+	sim_bus_delay(msgs, num);
+
+	spin_lock_irqsave(&s->lock, flags);
+
+	s->transfers++;
+	for (i = 0; i < num; i++)
+		s->bytes += msgs[i].len;
+
+	if (num == 1 && msgs[0].flags & I2C_M_RD) {
+		/* plain read of the input register */
+		sim_read_input(s, msgs[0].buf, msgs[0].len);
+	} else if (num == 1 && msgs[0].len >= 2) {
+		u16 reg = msgs[0].buf[0] | msgs[0].buf[1] << 8;
+
+		if (reg == SIM_REG_COMMAND)
+			sim_command(s, msgs[0].buf, msgs[0].len);
+	} else if (num == 2 && msgs[0].len >= 2 && msgs[1].flags & I2C_M_RD) {
+		sim_register_read(s, msgs[0].buf, msgs[0].len,
+				  msgs[1].buf, msgs[1].len);
+	} else {
+		num = -EOPNOTSUPP;
+	}
+
+	spin_unlock_irqrestore(&s->lock, flags);
+
+	return num;
+}
+
+static u32 sim_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm sim_algo = {
+	.master_xfer	= sim_xfer,
+	.functionality	= sim_func,
+};
+
+static int sim_stats_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid_sim *s = m->private;
+	ktime_t created = s->events[SIM_EV_CREATED];
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&s->lock, flags);
+
+	seq_printf(m, "generated:   %llu\n", s->generated);
+	seq_printf(m, "delivered:   %llu\n", s->delivered);
+	seq_printf(m, "overflows:   %llu\n", s->overflows);
+	seq_printf(m, "empty_reads: %llu\n", s->empty_reads);
+	seq_printf(m, "transfers:   %llu\n", s->transfers);
+	seq_printf(m, "bytes:       %llu\n", s->bytes);
+	seq_printf(m, "powered:     %d\n", s->powered);
+	seq_printf(m, "mt_enabled:  %d\n", s->mt_enabled);
+
+	/* probe timeline, relative to client creation */
+	for (i = SIM_EV_HID_DESC; i < SIM_EV_MAX; i++) {
+		if (!s->events[i])
+			continue;
+		seq_printf(m, "t_%s_us: %lld\n", sim_event_names[i],
+			   ktime_us_delta(s->events[i], created));
+	}
+	seq_printf(m, "resume_us:   %llu\n", div_u64(s->resume_ns,
+						     NSEC_PER_USEC));
+
+	spin_unlock_irqrestore(&s->lock, flags);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_stats);
+
+static int sim_irq_init(struct i2c_hid_sim *s)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,11,0)
+	int ret = irq_sim_init(&s->irq_sim, 1);
+
+	if (ret < 0)
+		return ret;
+
+	s->irq = irq_sim_irqnum(&s->irq_sim, 0);
+	return 0;
+#else
+	int ret;
+
+	s->irq_domain = irq_domain_create_sim(NULL, 1);
+	if (IS_ERR(s->irq_domain))
+		return PTR_ERR(s->irq_domain);
+
+	s->irq = irq_create_mapping(s->irq_domain, 0);
+	if (!s->irq) {
+		irq_domain_remove_sim(s->irq_domain);
+		return -ENXIO;
+	}
+
+	/*
+	 * irq_sim only takes edge triggers, without a type the driver asks for
+	 * a low level one and request_irq() fails.
+	 */
+	ret = irq_set_irq_type(s->irq, IRQ_TYPE_EDGE_RISING);
+	if (ret) {
+		irq_dispose_mapping(s->irq);
+		irq_domain_remove_sim(s->irq_domain);
+		return ret;
+	}
+	return 0;
+#endif
+}
+
+static void sim_irq_exit(struct i2c_hid_sim *s)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,11,0)
+	irq_sim_fini(&s->irq_sim);
+#else
+	irq_dispose_mapping(s->irq);
+	irq_domain_remove_sim(s->irq_domain);
+#endif
+}
+
+static int __init i2c_hid_sim_init(void)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("hid-over-i2c", 0x15),
+		.platform_data = &sim_pdata,
+	};
+	int ret;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return -ENOMEM;
+
+	spin_lock_init(&sim->lock);
+	hrtimer_init(&sim->stream_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	sim->stream_timer.function = sim_stream_timer;
+	hrtimer_init(&sim->reset_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	sim->reset_timer.function = sim_reset_timer;
+
+	ret = sim_irq_init(sim);
+	if (ret)
+		goto err_free;
+
+	sim->adap.owner = THIS_MODULE;
+	sim->adap.algo = &sim_algo;
+	strlcpy(sim->adap.name, "i2c-hid-sim", sizeof(sim->adap.name));
+	i2c_set_adapdata(&sim->adap, sim);
+
+	ret = i2c_add_adapter(&sim->adap);
+	if (ret)
+		goto err_irq;
+
+	sim->debugfs = debugfs_create_dir("i2c_hid_sim", NULL);
+	debugfs_create_file("stats", 0444, sim->debugfs, sim,
+			    &sim_stats_fops);
+
+	hrtimer_start(&sim->stream_timer,
+		      ns_to_ktime(NSEC_PER_SEC / max(rate_hz, 1U)),
+		      HRTIMER_MODE_REL);
+
+	info.irq = sim->irq;
+	sim_event(sim, SIM_EV_CREATED);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+	sim->client = i2c_new_device(&sim->adap, &info);
+	if (!sim->client) {
+		ret = -ENODEV;
+		goto err_adapter;
+	}
+#else
+	sim->client = i2c_new_client_device(&sim->adap, &info);
+	if (IS_ERR(sim->client)) {
+		ret = PTR_ERR(sim->client);
+		goto err_adapter;
+	}
+#endif
+
+	return 0;
+
+err_adapter:
+	hrtimer_cancel(&sim->stream_timer);
+	debugfs_remove_recursive(sim->debugfs);
+	i2c_del_adapter(&sim->adap);
+err_irq:
+	sim_irq_exit(sim);
+err_free:
+	kfree(sim);
+	return ret;
+}
+
+static void __exit i2c_hid_sim_exit(void)
+{
+	i2c_unregister_device(sim->client);
+	hrtimer_cancel(&sim->stream_timer);
+	hrtimer_cancel(&sim->reset_timer);
+	debugfs_remove_recursive(sim->debugfs);
+	i2c_del_adapter(&sim->adap);
+	sim_irq_exit(sim);
+	kfree(sim);
+}
+
+module_init(i2c_hid_sim_init);
+module_exit(i2c_hid_sim_exit);
+
+MODULE_DESCRIPTION("Simulated HID over I2C device");
+MODULE_LICENSE("GPL");
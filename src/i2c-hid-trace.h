@@ -0,0 +1,174 @@
+/*
+ * Tracepoints for the HID over I2C protocol implementation
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM i2c_hid
+
+#if !defined(_I2C_HID_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _I2C_HID_TRACE_H
+
+#include <linux/i2c.h>
+#include <linux/tracepoint.h>
+
+/* outcome of an input report read, see i2c_hid_get_input() */
+#define I2C_HID_INPUT_OK		0
+#define I2C_HID_INPUT_BUS_ERROR		1
+#define I2C_HID_INPUT_SHORT		2
+#define I2C_HID_INPUT_RESET		3
+#define I2C_HID_INPUT_INCOMPLETE	4
+#define I2C_HID_INPUT_DROPPED		5
+#define I2C_HID_INPUT_EMPTY		6
+#define I2C_HID_INPUT_OVERFLOW		7
+
+#define show_input_status(status)					\
+	__print_symbolic(status,					\
+		{ I2C_HID_INPUT_OK,		"ok" },			\
+		{ I2C_HID_INPUT_BUS_ERROR,	"bus_error" },		\
+		{ I2C_HID_INPUT_SHORT,		"short" },		\
+		{ I2C_HID_INPUT_RESET,		"reset" },		\
+		{ I2C_HID_INPUT_INCOMPLETE,	"incomplete" },		\
+		{ I2C_HID_INPUT_DROPPED,	"dropped" },		\
+		{ I2C_HID_INPUT_EMPTY,		"empty" },		\
+		{ I2C_HID_INPUT_OVERFLOW,	"overflow" })
+
+TRACE_EVENT(i2c_hid_command,
+	TP_PROTO(struct i2c_client *client, u8 opcode, u8 report_id,
+		 int write_len, int read_len, u64 duration_ns, int ret),
+
+	TP_ARGS(client, opcode, report_id, write_len, read_len, duration_ns,
+		ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&client->dev))
+		__field(u8, opcode)
+		__field(u8, report_id)
+		__field(int, write_len)
+		__field(int, read_len)
+		__field(u64, duration_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&client->dev));
+		__entry->opcode = opcode;
+		__entry->report_id = report_id;
+		__entry->write_len = write_len;
+		__entry->read_len = read_len;
+		__entry->duration_ns = duration_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s opcode=0x%02x report=0x%02x wlen=%d rlen=%d duration=%lluns ret=%d",
+		  __get_str(name), __entry->opcode, __entry->report_id,
+		  __entry->write_len, __entry->read_len,
+		  __entry->duration_ns, __entry->ret)
+);
+
+TRACE_EVENT(i2c_hid_get_input,
+	TP_PROTO(struct i2c_client *client, int size, int ret_size, int ret,
+		 int status),
+
+	TP_ARGS(client, size, ret_size, ret, status),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&client->dev))
+		__field(int, size)
+		__field(int, ret_size)
+		__field(int, ret)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&client->dev));
+		__entry->size = size;
+		__entry->ret_size = ret_size;
+		__entry->ret = ret;
+		__entry->status = status;
+	),
+
+	TP_printk("%s size=%d ret_size=%d ret=%d %s", __get_str(name),
+		  __entry->size, __entry->ret_size, __entry->ret,
+		  show_input_status(__entry->status))
+);
+
+TRACE_EVENT(i2c_hid_hwreset,
+	TP_PROTO(struct i2c_client *client, u64 duration_ns, int ret),
+
+	TP_ARGS(client, duration_ns, ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&client->dev))
+		__field(u64, duration_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&client->dev));
+		__entry->duration_ns = duration_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s duration=%lluns ret=%d", __get_str(name),
+		  __entry->duration_ns, __entry->ret)
+);
+
+TRACE_EVENT(i2c_hid_set_power,
+	TP_PROTO(struct i2c_client *client, int power_state, int ret),
+
+	TP_ARGS(client, power_state, ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&client->dev))
+		__field(int, power_state)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&client->dev));
+		__entry->power_state = power_state;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s state=%s ret=%d", __get_str(name),
+		  __entry->power_state ? "sleep" : "on", __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(i2c_hid_runtime_pm,
+	TP_PROTO(struct i2c_client *client),
+
+	TP_ARGS(client),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&client->dev))
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&client->dev));
+	),
+
+	TP_printk("%s", __get_str(name))
+);
+
+DEFINE_EVENT(i2c_hid_runtime_pm, i2c_hid_runtime_suspend,
+	TP_PROTO(struct i2c_client *client),
+	TP_ARGS(client)
+);
+
+DEFINE_EVENT(i2c_hid_runtime_pm, i2c_hid_runtime_resume,
+	TP_PROTO(struct i2c_client *client),
+	TP_ARGS(client)
+);
+
+#endif /* _I2C_HID_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE i2c-hid-trace
+
+#include <trace/define_trace.h>
@@ -39,6 +39,22 @@
 #include <linux/acpi.h>
 #include <linux/of.h>
 #include <linux/version.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/kref.h>
+#include <linux/jump_label.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/dma-mapping.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/firmware.h>
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
 #include <linux/i2c/i2c-hid.h>
@@ -46,7 +62,17 @@
 #include <linux/platform_data/i2c-hid.h>
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,16,0)
+#define I2C_M_DMA_SAFE		0
+#else
+#include <uapi/linux/sched/types.h>
+#endif
+
 #include "hid-ids.h"
+#include "i2c-hid-recorder.h"
+
+#define CREATE_TRACE_POINTS
+#include "i2c-hid-trace.h"
 
 /* quirks to control the device */
 #define I2C_HID_QUIRK_SET_PWR_WAKEUP_DEV	BIT(0)
@@ -55,22 +81,199 @@
 /* flags */
 #define I2C_HID_STARTED		0
 #define I2C_HID_RESET_PENDING	1
-#define I2C_HID_READ_PENDING	2
+#define I2C_HID_POLLING		2
+#define I2C_HID_RESUMING	3
 
 #define I2C_HID_PWR_ON		0x00
 #define I2C_HID_PWR_SLEEP	0x01
+#define I2C_HID_PWR_UNKNOWN	-1	/* i2c_hid->power_state only */
 
 /* debug option */
-static bool debug;
-module_param(debug, bool, 0444);
-MODULE_PARM_DESC(debug, "print a lot of debug information");
+enum i2c_hid_debug_mode {
+	I2C_HID_DEBUG_OFF,
+	I2C_HID_DEBUG_TEXT,	/* everything through printk */
+	I2C_HID_DEBUG_BINARY,	/* command and input bytes into debug_log */
+};
+
+static int debug;
+static DEFINE_STATIC_KEY_FALSE(i2c_hid_debug_key);
+
+/* the key patches the debug checks in and out, it can sleep */
+static int i2c_hid_debug_set(const char *val, const struct kernel_param *kp)
+{
+	int mode, ret;
+
+	ret = kstrtoint(val, 0, &mode);
+	if (ret) {
+		bool on;
+
+		/* y and n as the parameter took when it was a bool */
+		ret = kstrtobool(val, &on);
+		if (ret)
+			return ret;
+		mode = on ? I2C_HID_DEBUG_TEXT : I2C_HID_DEBUG_OFF;
+	}
+
+	if (mode < I2C_HID_DEBUG_OFF || mode > I2C_HID_DEBUG_BINARY)
+		return -EINVAL;
+
+	WRITE_ONCE(debug, mode);
+
+	if (mode)
+		static_branch_enable(&i2c_hid_debug_key);
+	else
+		static_branch_disable(&i2c_hid_debug_key);
+
+	return 0;
+}
+
+static const struct kernel_param_ops i2c_hid_debug_ops = {
+	.set	= i2c_hid_debug_set,
+	.get	= param_get_int,
+};
+
+module_param_cb(debug, &i2c_hid_debug_ops, &debug, 0644);
+MODULE_PARM_DESC(debug, "0/n = off, 1/y = print a lot of debug information, "
+		 "2 = like 1 but log command and input bytes to debugfs");
 
 #define i2c_hid_dbg(ihid, fmt, arg...)					  \
 do {									  \
-	if (debug)							  \
+	if (static_branch_unlikely(&i2c_hid_debug_key))			  \
 		dev_printk(KERN_DEBUG, &(ihid)->client->dev, fmt, ##arg); \
 } while (0)
 
+/* hex dumps of the per command and per report paths */
+#define i2c_hid_dbg_data(ihid, type, buf, len)				  \
+do {									  \
+	if (static_branch_unlikely(&i2c_hid_debug_key))			  \
+		i2c_hid_dbg_record(ihid, type, buf, len);		  \
+} while (0)
+
+static bool latency_stats;
+module_param(latency_stats, bool, 0644);
+MODULE_PARM_DESC(latency_stats, "record IRQ to input report latency histograms");
+
+static unsigned int drain_budget = 1;
+module_param(drain_budget, uint, 0644);
+MODULE_PARM_DESC(drain_budget, "maximum input reports read per interrupt (1 = no draining)");
+
+static unsigned int poll_threshold_hz;
+module_param(poll_threshold_hz, uint, 0644);
+MODULE_PARM_DESC(poll_threshold_hz, "switch from interrupts to polling above this report rate (0 = never)");
+
+static unsigned int poll_interval_us;
+module_param(poll_interval_us, uint, 0644);
+MODULE_PARM_DESC(poll_interval_us, "polling interval (0 = the measured report interval)");
+
+static unsigned int poll_idle_count = 4;
+module_param(poll_idle_count, uint, 0644);
+MODULE_PARM_DESC(poll_idle_count, "empty polls before going back to interrupts");
+
+static unsigned int poll_hz;
+module_param(poll_hz, uint, 0444);
+MODULE_PARM_DESC(poll_hz, "poll devices without an interrupt at this rate (0 = refuse them)");
+
+static bool force_poll;
+module_param(force_poll, bool, 0444);
+MODULE_PARM_DESC(force_poll, "poll at poll_hz even if the device has an interrupt, for broken interrupt lines");
+
+/* an idle device without interrupt is polled up to 8 times less often */
+#define I2C_HID_POLL_BACKOFF_SHIFT	3
+
+/* how often a polled device is read while waiting for a reset */
+#define I2C_HID_RESET_POLL_MS	10
+
+/* the report rate is measured over windows of this length */
+#define I2C_HID_RATE_WINDOW_NS	(100 * NSEC_PER_MSEC)
+
+static unsigned int recorder_slots;
+module_param(recorder_slots, uint, 0444);
+MODULE_PARM_DESC(recorder_slots, "input reports kept by the flight recorder (0 = off)");
+
+enum i2c_hid_read_mode {
+	I2C_HID_READ_MAX,	/* wMaxInputLength, as the specification asks */
+	I2C_HID_READ_REPORT,	/* largest input report of the descriptor */
+	I2C_HID_READ_RECV_LEN,	/* let the length byte end the transfer */
+};
+
+static int read_mode = I2C_HID_READ_MAX;
+module_param(read_mode, int, 0644);
+MODULE_PARM_DESC(read_mode, "input read length: 0 = wMaxInputLength, 1 = largest input report, 2 = length prefixed read where supported");
+
+static bool dma_safe = true;
+module_param(dma_safe, bool, 0644);
+MODULE_PARM_DESC(dma_safe, "let the I2C adapter DMA directly into the transfer buffers");
+
+static unsigned int pipeline_slots;
+module_param(pipeline_slots, uint, 0444);
+MODULE_PARM_DESC(pipeline_slots, "hand input reports to a worker through a ring of this many reports (0 = decode in the IRQ thread)");
+
+static int pipeline_cpu = -1;
+module_param(pipeline_cpu, int, 0644);
+MODULE_PARM_DESC(pipeline_cpu, "CPU the pipeline worker runs on (-1 = any)");
+
+#define I2C_HID_PIPE_MAX_SLOTS	256
+
+static int irq_priority;
+module_param(irq_priority, int, 0444);
+MODULE_PARM_DESC(irq_priority, "SCHED_FIFO priority of the IRQ threads (0 = kernel default)");
+
+static char *irq_cpus;
+module_param(irq_cpus, charp, 0444);
+MODULE_PARM_DESC(irq_cpus, "CPU list the interrupts and IRQ threads run on (default: any)");
+
+/* the kernel runs IRQ threads at SCHED_FIFO, MAX_RT_PRIO / 2 */
+#define I2C_HID_IRQ_PRIO_DEFAULT	50
+
+static int autosuspend_delay_ms = 2000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms, "runtime suspend a device this long after its last use (0 = at once)");
+
+static bool async_resume;
+module_param(async_resume, bool, 0644);
+MODULE_PARM_DESC(async_resume, "reset devices after system resume in the background");
+
+static bool suspend_wake = true;
+module_param(suspend_wake, bool, 0644);
+MODULE_PARM_DESC(suspend_wake, "wake runtime suspended devices for the HID driver's suspend callback");
+
+static bool deferred_add;
+module_param(deferred_add, bool, 0444);
+MODULE_PARM_DESC(deferred_add, "reset and register devices after probe returned, in the background");
+
+static bool rdesc_cache;
+module_param(rdesc_cache, bool, 0644);
+MODULE_PARM_DESC(rdesc_cache, "reuse report descriptors read before or found in /lib/firmware/i2c-hid/");
+
+static bool lazy_init_reports;
+module_param(lazy_init_reports, bool, 0644);
+MODULE_PARM_DESC(lazy_init_reports, "fetch the initial feature reports in the background after start");
+
+static unsigned int feature_cache_ms;
+module_param(feature_cache_ms, uint, 0644);
+MODULE_PARM_DESC(feature_cache_ms, "serve feature report reads from a cache this long (0 = off), see feature_cache/ttl_ms for per report values");
+
+static unsigned int request_slots = 4;
+module_param(request_slots, uint, 0444);
+MODULE_PARM_DESC(request_slots, "number of GET_REPORT requests that can be in progress at once per device");
+
+/* bits of i2c_hid->req_free */
+#define I2C_HID_MAX_REQS	32
+
+/* retry interval of the background fetch while the HID driver is busy */
+#define I2C_HID_INIT_RETRY_MS	100
+
+/* bytes of a cached report descriptor compared with the device */
+#define I2C_HID_RDESC_CHECK_LEN	64
+
+/* sched_check suggests tuning above this p99 scheduling delay */
+#define I2C_HID_SCHED_DELAY_WARN_NS	NSEC_PER_MSEC
+
+/* 64k slots are 4MB per device, more is certainly a mistake */
+#define I2C_HID_REC_MAX_SLOTS	(1U << 16)
+
+static struct dentry *i2c_hid_debugfs_root;
+
 struct i2c_hid_desc {
 	__le16 wHIDDescLength;
 	__le16 bcdVersion;
@@ -88,6 +291,20 @@ struct i2c_hid_desc {
 	__le32 reserved;
 } __packed;
 
+/*
+ * Report descriptors by HID descriptor, which contains the IDs, version
+ * and descriptor length. Kept until the module is unloaded so that
+ * rebinding a device does not read the descriptor again.
+ */
+struct i2c_hid_rdesc_entry {
+	struct list_head	list;
+	struct i2c_hid_desc	hdesc;
+	u8			*data;
+};
+
+static LIST_HEAD(i2c_hid_rdesc_list);
+static DEFINE_MUTEX(i2c_hid_rdesc_lock);
+
 struct i2c_hid_cmd {
 	unsigned int registerIndex;
 	__u8 opcode;
@@ -138,6 +355,161 @@ static const struct i2c_hid_cmd hid_no_cmd =		{ .length = 0 };
 static DEFINE_MUTEX(i2c_hid_open_mut);
 #endif
 
+/* stages of an input report, from the interrupt to the HID driver */
+enum i2c_hid_lat_stage {
+	I2C_HID_LAT_SCHED,	/* hard IRQ until the IRQ thread runs */
+	I2C_HID_LAT_BUS,	/* reading the input report */
+	I2C_HID_LAT_DECODE,	/* hid_input_report() and the HID driver */
+	I2C_HID_LAT_STAGES
+};
+
+static const char * const i2c_hid_lat_names[I2C_HID_LAT_STAGES] = {
+	[I2C_HID_LAT_SCHED]	= "sched",
+	[I2C_HID_LAT_BUS]	= "bus",
+	[I2C_HID_LAT_DECODE]	= "decode",
+};
+
+/* log2 buckets of nanoseconds, the last one collects everything above 2s */
+#define I2C_HID_LAT_BUCKETS	32
+
+struct i2c_hid_lat_hist {
+	u64 buckets[I2C_HID_LAT_STAGES][I2C_HID_LAT_BUCKETS];
+};
+
+/* per device counters, summed over all CPUs when read through sysfs */
+struct i2c_hid_stats {
+	u64 frames;		/* input reports given to the HID core */
+	u64 short_reads;	/* input reads returning less than asked */
+	u64 incomplete;		/* reports larger than wMaxInputLength */
+	u64 dropped;		/* reports received before start or
+				 * while resuming */
+	u64 bus_errors;		/* failed input reads and commands */
+	u64 resets;		/* zero length reports of a reset */
+	u64 irq_ignored;	/* IRQs seen while a command was reading */
+	u64 irq_wakeups;	/* IRQ thread runs that read input */
+	u64 drained;		/* reports read after the first of a wakeup */
+	u64 drain_empty;	/* drain reads that found no report */
+	u64 empty_reads;	/* zero length reports with no reset pending */
+	u64 poll_enter;		/* switches from interrupts to polling */
+	u64 poll_exit;		/* and back */
+	u64 polls;		/* polls done while polling */
+	u64 polls_empty;	/* polls that found no report */
+	u64 bytes_read;
+	u64 bytes_written;
+	u64 xfer_ns;		/* time spent inside I2C transfers */
+	u64 xfers;		/* I2C transfers done */
+	u64 dma_xfers;		/* of which with DMA safe buffers */
+	u64 pipe_overflow;	/* reports lost to a full pipeline ring */
+	u64 runtime_suspends;	/* power transitions of runtime PM */
+	u64 runtime_resumes;
+	u64 power_cmds;		/* SET_POWER commands sent */
+	u64 power_skipped;	/* not sent, the device was in that state */
+	u64 rdesc_hits;		/* report descriptors from the cache */
+	u64 rdesc_misses;	/* read from the device */
+	u64 rdesc_stale;	/* cached, but the device disagreed */
+	u64 feature_hits;	/* feature report reads from the cache */
+	u64 feature_misses;	/* cacheable, but read from the device */
+	u64 req_waits;		/* GET_REPORT waited for a free buffer */
+	u64 cmd_queued;		/* command waited for the one before it */
+};
+
+/* last GET_REPORT of a feature report, for feature_cache_ms */
+struct i2c_hid_feature {
+	u8			*data;
+	unsigned int		len;		/* 0: nothing cached */
+	int			ttl_ms;		/* -1: feature_cache_ms */
+	ktime_t			time;
+	unsigned int		gen;		/* bumped on invalidation */
+};
+
+/*
+ * The flight recorder may still be mapped by userspace when the device
+ * goes away, the last unmap frees it.
+ */
+struct i2c_hid_recorder {
+	struct kref		ref;
+	struct i2c_hid_rec_header *hdr;	/* vmalloc_user, header + slots */
+	struct i2c_hid_rec_slot	*slots;
+	size_t			size;
+	u32			mask;		/* nr_slots - 1 */
+	u64			head;
+};
+
+/*
+ * Single producer, single consumer ring between the thread reading the
+ * device (always under input_lock) and the worker decoding the reports.
+ */
+struct i2c_hid_pipe_slot {
+	ktime_t			irq_time;
+	ktime_t			read_done;
+	unsigned int		len;
+	u8			*data;
+};
+
+struct i2c_hid_pipe {
+	unsigned int		head;		/* written by the reader */
+	unsigned int		tail ____cacheline_aligned_in_smp;
+	unsigned int		mask;		/* nr_slots - 1 */
+	struct i2c_hid_pipe_slot slots[];
+};
+
+enum i2c_hid_dbg_type {
+	I2C_HID_DBG_CMD,
+	I2C_HID_DBG_INPUT,
+};
+
+/* device bring-up phases, see the boot_times debugfs file */
+enum i2c_hid_boot_phase {
+	I2C_HID_BOOT_DESC,	/* fetching the HID descriptor */
+	I2C_HID_BOOT_IRQ,	/* requesting the interrupt */
+	I2C_HID_BOOT_PROBE,	/* the whole probe callback */
+	I2C_HID_BOOT_RESET,	/* resets, including retries */
+	I2C_HID_BOOT_RDESC,	/* reading the report descriptor */
+	I2C_HID_BOOT_PARSE,	/* hid_parse_report() */
+	I2C_HID_BOOT_INIT,	/* fetching the initial reports */
+	I2C_HID_BOOT_ADD,	/* hid_add_device(), contains the above 4 */
+	I2C_HID_BOOT_READY,	/* probe start until the device is added */
+	I2C_HID_BOOT_PHASES
+};
+
+static const char * const i2c_hid_boot_names[I2C_HID_BOOT_PHASES] = {
+	[I2C_HID_BOOT_DESC]	= "desc",
+	[I2C_HID_BOOT_IRQ]	= "irq",
+	[I2C_HID_BOOT_PROBE]	= "probe",
+	[I2C_HID_BOOT_RESET]	= "reset",
+	[I2C_HID_BOOT_RDESC]	= "report_desc",
+	[I2C_HID_BOOT_PARSE]	= "parse",
+	[I2C_HID_BOOT_INIT]	= "init_reports",
+	[I2C_HID_BOOT_ADD]	= "add",
+	[I2C_HID_BOOT_READY]	= "ready",
+};
+
+static const char * const i2c_hid_dbg_names[] = {
+	[I2C_HID_DBG_CMD]	= "cmd=",
+	[I2C_HID_DBG_INPUT]	= "input: ",
+};
+
+#define I2C_HID_DBG_LOG_RECORDS	256	/* power of two */
+#define I2C_HID_DBG_LOG_DATA	44
+
+/* binary debug records, only formatted when debug_log is read */
+struct i2c_hid_dbg_rec {
+	u64	timestamp_ns;
+	u16	len;		/* full length, data holds the first bytes */
+	u8	type;
+	u8	data[I2C_HID_DBG_LOG_DATA];
+};
+
+struct i2c_hid_dbg_log {
+	spinlock_t		lock;
+	unsigned long		head;	/* records written so far */
+	struct i2c_hid_dbg_rec	recs[I2C_HID_DBG_LOG_RECORDS];
+};
+
+#define i2c_hid_stat_inc(ihid, field)	this_cpu_inc((ihid)->stats->field)
+#define i2c_hid_stat_add(ihid, field, val) \
+	this_cpu_add((ihid)->stats->field, val)
+
 /* The main device structure */
 struct i2c_hid {
 	struct i2c_client	*client;	/* i2c client */
@@ -151,10 +523,21 @@ struct i2c_hid {
 						   * descriptor. */
 	unsigned int		bufsize;	/* i2c buffer size */
 	char			*inbuf;		/* Input buffer */
-	char			*rawbuf;	/* Raw Input buffer */
 	char			*cmdbuf;	/* Command buffer */
 	char			*argsbuf;	/* Command arguments buffer */
 
+	/* GET_REPORT reply buffers, each bufsize bytes */
+	u8			*req_buf[I2C_HID_MAX_REQS];
+	unsigned int		nr_reqs;
+	unsigned long		req_free;	/* bitmap of req_buf */
+	wait_queue_head_t	req_wait;
+
+	/* commands go out in ticket order, they share cmdbuf */
+	atomic_t		cmd_next;
+	unsigned int		cmd_serving;
+	wait_queue_head_t	cmd_wait;
+	atomic_t		reads_pending;	/* commands reading a reply */
+
 	unsigned long		flags;		/* device flags */
 	unsigned long		quirks;		/* Various quirks */
 
@@ -167,6 +550,60 @@ struct i2c_hid {
 
 	__u32			reset_usleep_low;
 	__u32			reset_usleep_high;
+
+	ktime_t			irq_time;	/* set by the hard IRQ handler */
+	struct i2c_hid_lat_hist __percpu *lat;	/* latency histograms */
+	struct i2c_hid_stats __percpu *stats;	/* frame and bus counters */
+	struct i2c_hid_recorder	*rec;		/* raw input flight recorder */
+	struct i2c_hid_dbg_log	*dbg_log;	/* debug=2 records */
+
+	bool			polled;		/* no usable interrupt */
+	struct mutex		input_lock;	/* IRQ thread vs polling */
+	ktime_t			rate_start;	/* report rate window */
+	unsigned int		rate_reports;
+	u64			poll_interval_ns;
+	unsigned int		poll_idle;	/* consecutive empty polls */
+	struct hrtimer		poll_timer;
+	struct work_struct	poll_work;
+	struct dentry		*debugfs;	/* per device debugfs dir */
+
+	unsigned int		input_len;	/* largest input report seen */
+	bool			recv_len;	/* adapter does I2C_M_RECV_LEN */
+
+	struct i2c_hid_pipe	*pipe;		/* set while started */
+	struct work_struct	pipe_work;
+
+	struct mutex		sched_lock;	/* IRQ thread scheduling */
+	int			sched_policy;
+	int			sched_prio;	/* RT priority or nice value */
+	unsigned int		sched_gen;	/* bumped by every change */
+	unsigned int		sched_applied;	/* by the IRQ thread */
+	pid_t			irq_pid;
+	cpumask_var_t		irq_cpus;	/* empty: leave the affinity */
+
+	struct work_struct	resume_work;	/* async_resume */
+	ktime_t			resume_start;
+	u64			resume_blocked_ns; /* in the last resume callback */
+	u64			resume_ready_ns;   /* until input was let through */
+	int			resume_ret;
+	bool			resume_async;
+
+	int			power_state;	/* last SET_POWER that worked */
+	u64			suspend_ns;	/* the last suspend callback */
+	u64			suspend_power_cmds;
+	bool			suspend_rpm;	/* was runtime suspended */
+	bool			suspend_woken;	/* for the HID driver */
+
+	struct work_struct	add_work;	/* deferred_add */
+	ktime_t			boot_start;
+	u64			boot_ns[I2C_HID_BOOT_PHASES];
+	int			boot_resets;	/* reset attempts */
+
+	struct mutex		feature_lock;
+	struct i2c_hid_feature	*features;	/* by report ID */
+
+	struct delayed_work	init_work;	/* lazy_init_reports */
+	DECLARE_BITMAP(init_pending, HID_MAX_IDS); /* feature report IDs */
 };
 
 static const struct i2c_hid_quirks {
@@ -208,6 +645,158 @@ static const struct i2c_hid_quirks* i2c_hid_lookup_quirk(const u16 idVendor, con
 	return quirks;
 }
 
+static void i2c_hid_lat_record(struct i2c_hid *ihid,
+		enum i2c_hid_lat_stage stage, ktime_t start, ktime_t end)
+{
+	s64 ns = ktime_to_ns(ktime_sub(end, start));
+	unsigned int bucket = 0;
+
+	if (ns > 0)
+		bucket = min_t(unsigned int, ilog2((u64)ns),
+			       I2C_HID_LAT_BUCKETS - 1);
+
+	this_cpu_inc(ihid->lat->buckets[stage][bucket]);
+}
+
+/* returns the end of the phase, the start of the next one */
+static ktime_t i2c_hid_boot_record(struct i2c_hid *ihid,
+		enum i2c_hid_boot_phase phase, ktime_t start)
+{
+	ktime_t end = ktime_get();
+
+	ihid->boot_ns[phase] = ktime_to_ns(ktime_sub(end, start));
+	return end;
+}
+
+static void i2c_hid_dbg_record(struct i2c_hid *ihid,
+		enum i2c_hid_dbg_type type, const void *buf, int len)
+{
+	struct i2c_hid_dbg_log *log = ihid->dbg_log;
+	struct i2c_hid_dbg_rec *rec;
+
+	if (READ_ONCE(debug) != I2C_HID_DEBUG_BINARY) {
+		dev_printk(KERN_DEBUG, &ihid->client->dev, "%s%*ph\n",
+			   i2c_hid_dbg_names[type], len, buf);
+		return;
+	}
+
+	/* commands and input reports may be logged concurrently */
+	spin_lock(&log->lock);
+	rec = &log->recs[log->head++ & (I2C_HID_DBG_LOG_RECORDS - 1)];
+	rec->timestamp_ns = ktime_get_ns();
+	rec->type = type;
+	rec->len = len;
+	memcpy(rec->data, buf, min_t(int, len, sizeof(rec->data)));
+	spin_unlock(&log->lock);
+}
+
+/* called from the input path only, so there is a single writer */
+static void i2c_hid_rec_add(struct i2c_hid_recorder *rec, ktime_t timestamp,
+		const u8 *data, int len)
+{
+	struct i2c_hid_rec_slot *slot = &rec->slots[rec->head & rec->mask];
+
+	len = clamp(len, 0, (int)U16_MAX);
+
+	WRITE_ONCE(slot->seq, 0);
+	smp_wmb();
+	slot->timestamp_ns = ktime_to_ns(timestamp);
+	slot->len = len;
+	memcpy(slot->data, data, min_t(int, len, sizeof(slot->data)));
+	smp_wmb();
+	WRITE_ONCE(slot->seq, ++rec->head);
+	WRITE_ONCE(rec->hdr->head, rec->head);
+}
+
+/*
+ * Transfer buffers are allocated in whole cache lines so that a
+ * non-coherent DMA into them cannot clobber a neighbouring allocation.
+ */
+static void *i2c_hid_dma_alloc(size_t size)
+{
+	return kzalloc(ALIGN(size, dma_get_cache_alignment()), GFP_KERNEL);
+}
+
+/*
+ * Everything i2c-hid passes to the I2C core comes from i2c_hid_dma_alloc()
+ * except for the HID descriptor, which shares cache lines with the rest of
+ * struct i2c_hid.
+ */
+static u16 i2c_hid_dma_flag(struct i2c_hid *ihid, const void *buf)
+{
+	if (!READ_ONCE(dma_safe) ||
+	    (buf >= (void *)ihid && buf < (void *)(ihid + 1)))
+		return 0;
+
+	return I2C_M_DMA_SAFE;
+}
+
+static int i2c_hid_transfer(struct i2c_hid *ihid, struct i2c_msg *msgs,
+		int num)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = i2c_transfer(ihid->client->adapter, msgs, num);
+
+	i2c_hid_stat_add(ihid, xfer_ns,
+			 ktime_to_ns(ktime_sub(ktime_get(), start)));
+	i2c_hid_stat_inc(ihid, xfers);
+	if (msgs[num - 1].flags & I2C_M_DMA_SAFE)
+		i2c_hid_stat_inc(ihid, dma_xfers);
+
+	return ret;
+}
+
+static int i2c_hid_get_input(struct i2c_hid *ihid, bool speculative);
+
+/*
+ * Devices without an interrupt don't announce the reset sentinel, read the
+ * input register until it shows up, with the same bound as the interrupt
+ * driven wait. The poll work reads it too, whichever comes first.
+ */
+static int i2c_hid_poll_reset(struct i2c_hid *ihid)
+{
+	unsigned long timeout = jiffies + msecs_to_jiffies(5000);
+
+	while (test_bit(I2C_HID_RESET_PENDING, &ihid->flags)) {
+		if (time_after(jiffies, timeout))
+			return -ENODATA;
+
+		msleep(I2C_HID_RESET_POLL_MS);
+
+		mutex_lock(&ihid->input_lock);
+		if (test_bit(I2C_HID_RESET_PENDING, &ihid->flags))
+			i2c_hid_get_input(ihid, true);
+		mutex_unlock(&ihid->input_lock);
+	}
+
+	return 0;
+}
+
+/*
+ * Wait for the turn of the caller to send a command. Tickets are served in
+ * the order they were taken, so a busy hidraw reader cannot keep the others
+ * off the bus the way it can with a mutex.
+ */
+static void i2c_hid_cmd_queue(struct i2c_hid *ihid)
+{
+	unsigned int ticket = atomic_inc_return(&ihid->cmd_next) - 1;
+
+	if (smp_load_acquire(&ihid->cmd_serving) == ticket)
+		return;
+
+	i2c_hid_stat_inc(ihid, cmd_queued);
+	wait_event(ihid->cmd_wait,
+		   smp_load_acquire(&ihid->cmd_serving) == ticket);
+}
+
+static void i2c_hid_cmd_done(struct i2c_hid *ihid)
+{
+	smp_store_release(&ihid->cmd_serving, ihid->cmd_serving + 1);
+	wake_up_all(&ihid->cmd_wait);
+}
+
 static int __i2c_hid_command(struct i2c_client *client,
 		const struct i2c_hid_cmd *command, u8 reportID,
 		u8 reportType, u8 *args, int args_len,
@@ -218,11 +807,17 @@ static int __i2c_hid_command(struct i2c_client *client,
 	int ret;
 	struct i2c_msg msg[2];
 	int msg_num = 1;
+	ktime_t start = 0;
 
 	int length = command->length;
 	bool wait = command->wait;
 	unsigned int registerIndex = command->registerIndex;
 
+	if (trace_i2c_hid_command_enabled())
+		start = ktime_get();
+
+	i2c_hid_cmd_queue(ihid);
+
 	/* special case for hid_descr_cmd */
 	if (command == &hid_descr_cmd) {
 		cmd->c.reg = ihid->wHIDDescRegister;
@@ -239,44 +834,65 @@ static int __i2c_hid_command(struct i2c_client *client,
 	memcpy(cmd->data + length, args, args_len);
 	length += args_len;
 
-	i2c_hid_dbg(ihid, "%s: cmd=%*ph\n", __func__, length, cmd->data);
+	i2c_hid_dbg_data(ihid, I2C_HID_DBG_CMD, cmd->data, length);
 
 	msg[0].addr = client->addr;
 	msg[0].flags = client->flags & I2C_M_TEN;
+	msg[0].flags |= i2c_hid_dma_flag(ihid, cmd->data);
 	msg[0].len = length;
 	msg[0].buf = cmd->data;
 	if (data_len > 0) {
 		msg[1].addr = client->addr;
 		msg[1].flags = client->flags & I2C_M_TEN;
-		msg[1].flags |= I2C_M_RD;
+		msg[1].flags |= I2C_M_RD | i2c_hid_dma_flag(ihid, buf_recv);
 		msg[1].len = data_len;
 		msg[1].buf = buf_recv;
 		msg_num = 2;
-		set_bit(I2C_HID_READ_PENDING, &ihid->flags);
+		atomic_inc(&ihid->reads_pending);
 	}
 
 	if (wait)
 		set_bit(I2C_HID_RESET_PENDING, &ihid->flags);
 
-	ret = i2c_transfer(client->adapter, msg, msg_num);
+	ret = i2c_hid_transfer(ihid, msg, msg_num);
 
 	if (data_len > 0)
-		clear_bit(I2C_HID_READ_PENDING, &ihid->flags);
+		atomic_dec(&ihid->reads_pending);
 
-	if (ret != msg_num)
-		return ret < 0 ? ret : -EIO;
+	/* waiting for the reset does not need the bus */
+	i2c_hid_cmd_done(ihid);
+
+	if (ret != msg_num) {
+		i2c_hid_stat_inc(ihid, bus_errors);
+		ret = ret < 0 ? ret : -EIO;
+		goto out;
+	}
+
+	i2c_hid_stat_add(ihid, bytes_written, length);
+	if (data_len > 0)
+		i2c_hid_stat_add(ihid, bytes_read, data_len);
 
 	ret = 0;
 
 	if (wait) {
 		i2c_hid_dbg(ihid, "%s: waiting...\n", __func__);
-		if (!wait_event_timeout(ihid->wait,
+		if (ihid->polled) {
+			ret = i2c_hid_poll_reset(ihid);
+		} else if (!wait_event_timeout(ihid->wait,
 				!test_bit(I2C_HID_RESET_PENDING, &ihid->flags),
-				msecs_to_jiffies(5000)))
+				msecs_to_jiffies(5000))) {
 			ret = -ENODATA;
+		}
 		i2c_hid_dbg(ihid, "%s: finished.\n", __func__);
 	}
 
+out:
+	if (trace_i2c_hid_command_enabled())
+		trace_i2c_hid_command(client, command->opcode, reportID,
+				      length, data_len,
+				      ktime_to_ns(ktime_sub(ktime_get(), start)),
+				      ret);
+
 	return ret;
 }
 
@@ -400,6 +1016,13 @@ static int i2c_hid_set_power(struct i2c_client *client, int power_state)
 
 	i2c_hid_dbg(ihid, "%s\n", __func__);
 
+	if (power_state == ihid->power_state) {
+		i2c_hid_stat_inc(ihid, power_skipped);
+		return 0;
+	}
+
+	i2c_hid_stat_inc(ihid, power_cmds);
+
 	/*
 	 * Some devices require to send a command to wakeup before power on.
 	 * The call will get a return value (EREMOTEIO) but device will be
@@ -421,16 +1044,36 @@ static int i2c_hid_set_power(struct i2c_client *client, int power_state)
 		dev_err(&client->dev, "failed to change power setting.\n");
 
 set_pwr_exit:
+	ihid->power_state = ret ? I2C_HID_PWR_UNKNOWN : power_state;
+	trace_i2c_hid_set_power(client, power_state, ret);
 	return ret;
 }
 
+/* drops cached feature reports of one report ID, or all of them if < 0 */
+static void i2c_hid_feature_invalidate(struct i2c_hid *ihid, int id)
+{
+	int i;
+
+	mutex_lock(&ihid->feature_lock);
+	for (i = 0; i < HID_MAX_IDS; i++)
+		if (id < 0 || i == id) {
+			ihid->features[i].len = 0;
+			ihid->features[i].gen++;
+		}
+	mutex_unlock(&ihid->feature_lock);
+}
+
 static int i2c_hid_hwreset(struct i2c_client *client)
 {
 	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	ktime_t start = 0;
 	int ret;
 
 	i2c_hid_dbg(ihid, "%s\n", __func__);
 
+	if (trace_i2c_hid_hwreset_enabled())
+		start = ktime_get();
+
 	/*
 	 * This prevents sending feature reports while the device is
 	 * being reset. Otherwise we may lose the reset complete
@@ -438,6 +1081,9 @@ static int i2c_hid_hwreset(struct i2c_client *client)
 	 */
 	mutex_lock(&ihid->reset_lock);
 
+	/* a reset is when the tracked power state may be wrong */
+	ihid->power_state = I2C_HID_PWR_UNKNOWN;
+	i2c_hid_feature_invalidate(ihid, -1);
 	ret = i2c_hid_set_power(client, I2C_HID_PWR_ON);
 	if (ret)
 		goto out_unlock;
@@ -455,600 +1101,2502 @@ static int i2c_hid_hwreset(struct i2c_client *client)
 
 out_unlock:
 	mutex_unlock(&ihid->reset_lock);
+
+	if (trace_i2c_hid_hwreset_enabled())
+		trace_i2c_hid_hwreset(client,
+				      ktime_to_ns(ktime_sub(ktime_get(), start)),
+				      ret);
+
 	return ret;
 }
 
-static void i2c_hid_get_input(struct i2c_hid *ihid)
+/*
+ * Stamp the events of the next report with the hard interrupt time instead
+ * of the time they reach the input core, after the IRQ thread was scheduled
+ * and the I2C read completed. Passing 0 clears the stamp again, so inputs
+ * that had no events in this report do not keep it for a later one.
+ */
+static void i2c_hid_set_input_timestamp(struct i2c_hid *ihid, ktime_t time)
 {
-	int ret, ret_size;
-	int size = le16_to_cpu(ihid->hdesc.wMaxInputLength);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0)
+	struct hid_input *hidinput;
 
-	if (size > ihid->bufsize)
-		size = ihid->bufsize;
-
-	ret = i2c_master_recv(ihid->client, ihid->inbuf, size);
-	if (ret != size) {
-		if (ret < 0)
-			return;
-
-		dev_err(&ihid->client->dev, "%s: got %d data instead of %d\n",
-			__func__, ret, size);
+	if (!(ihid->hid->claimed & HID_CLAIMED_INPUT))
 		return;
-	}
 
-	ret_size = ihid->inbuf[0] | ihid->inbuf[1] << 8;
+	list_for_each_entry(hidinput, &ihid->hid->inputs, list)
+		input_set_timestamp(hidinput->input, time);
+#endif
+}
 
-	if (!ret_size) {
-		/* host or device initiated RESET completed */
-		if (test_and_clear_bit(I2C_HID_RESET_PENDING, &ihid->flags))
-			wake_up(&ihid->wait);
-		return;
-	}
+/*
+ * Every read transfer starts a new input report, so the length header
+ * cannot be read in a transfer of its own. SMBus block reads have the same
+ * problem, I2C_M_RECV_LEN makes the adapter take the first byte it
+ * receives as the number of bytes still to read. Here that is the low byte
+ * of the report length, so this only works for reports of up to
+ * I2C_SMBUS_BLOCK_MAX bytes, and reads one byte more than the report.
+ */
+static int i2c_hid_recv_input(struct i2c_hid *ihid, int size, bool recv_len)
+{
+	struct i2c_client *client = ihid->client;
+	struct i2c_msg msg = {
+		.addr = client->addr,
+		.flags = (client->flags & I2C_M_TEN) | I2C_M_RD,
+		.len = size,
+		.buf = ihid->inbuf,
+	};
+	int ret;
 
-	if (ret_size > size) {
-		dev_err(&ihid->client->dev, "%s: incomplete report (%d/%d)\n",
-			__func__, size, ret_size);
-		return;
+	msg.flags |= i2c_hid_dma_flag(ihid, msg.buf);
+	if (recv_len) {
+		msg.flags |= I2C_M_RECV_LEN;
+		msg.len = 1;
 	}
 
-	i2c_hid_dbg(ihid, "input: %*ph\n", ret_size, ihid->inbuf);
+	ret = i2c_hid_transfer(ihid, &msg, 1);
+	if (ret != 1)
+		return ret < 0 ? ret : -EIO;
+
+	return msg.len;
+}
+
+static int i2c_hid_input_size(struct i2c_hid *ihid, int mode)
+{
+	int size = le16_to_cpu(ihid->hdesc.wMaxInputLength);
 
-	if (test_bit(I2C_HID_STARTED, &ihid->flags))
-		hid_input_report(ihid->hid, HID_INPUT_REPORT, ihid->inbuf + 2,
-				ret_size - 2, 1);
+	/* input_len is only known once the report descriptor is parsed */
+	if (mode != I2C_HID_READ_MAX && ihid->input_len &&
+	    ihid->input_len < size)
+		size = ihid->input_len;
 
-	return;
+	return min_t(int, size, ihid->bufsize);
 }
 
-static irqreturn_t i2c_hid_irq(int irq, void *dev_id)
+static struct i2c_hid_pipe *i2c_hid_pipe_alloc(unsigned int nr_slots,
+		unsigned int size)
 {
-	struct i2c_hid *ihid = dev_id;
+	struct i2c_hid_pipe *pipe;
+	unsigned int i;
+	u8 *data;
+
+	nr_slots = roundup_pow_of_two(min_t(unsigned int, nr_slots,
+					    I2C_HID_PIPE_MAX_SLOTS));
+
+	pipe = kzalloc(sizeof(*pipe) + nr_slots * sizeof(pipe->slots[0]),
+		       GFP_KERNEL);
+	data = kcalloc(nr_slots, size, GFP_KERNEL);
+	if (!pipe || !data) {
+		kfree(pipe);
+		kfree(data);
+		return NULL;
+	}
 
-	if (test_bit(I2C_HID_READ_PENDING, &ihid->flags))
-		return IRQ_HANDLED;
+	pipe->mask = nr_slots - 1;
+	for (i = 0; i < nr_slots; i++)
+		pipe->slots[i].data = data + i * size;
 
-	i2c_hid_get_input(ihid);
+	return pipe;
+}
 
-	return IRQ_HANDLED;
+static void i2c_hid_pipe_free(struct i2c_hid_pipe *pipe)
+{
+	if (pipe)
+		kfree(pipe->slots[0].data);
+	kfree(pipe);
 }
 
-static int i2c_hid_get_report_length(struct hid_report *report)
+static bool i2c_hid_pipe_push(struct i2c_hid *ihid, struct i2c_hid_pipe *pipe,
+		const u8 *buf, unsigned int len, ktime_t read_done)
 {
-	return ((report->size - 1) >> 3) + 1 +
-		report->device->report_enum[report->type].numbered + 2;
+	unsigned int head = pipe->head;
+	struct i2c_hid_pipe_slot *slot;
+	int cpu;
+
+	/* pairs with the release of tail in i2c_hid_pipe_work() */
+	if (head - smp_load_acquire(&pipe->tail) > pipe->mask) {
+		i2c_hid_stat_inc(ihid, pipe_overflow);
+		return false;
+	}
+
+	slot = &pipe->slots[head & pipe->mask];
+	memcpy(slot->data, buf, len);
+	slot->len = len;
+	slot->irq_time = ihid->irq_time;
+	slot->read_done = read_done;
+	smp_store_release(&pipe->head, head + 1);
+
+	cpu = READ_ONCE(pipeline_cpu);
+	if (cpu >= 0 && cpu < nr_cpu_ids && cpu_online(cpu))
+		queue_work_on(cpu, system_highpri_wq, &ihid->pipe_work);
+	else
+		queue_work(system_highpri_wq, &ihid->pipe_work);
+
+	return true;
 }
 
-static void i2c_hid_init_report(struct hid_report *report, u8 *buffer,
-	size_t bufsize)
+static void i2c_hid_pipe_work(struct work_struct *work)
 {
-	struct hid_device *hid = report->device;
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	unsigned int size, ret_size;
+	struct i2c_hid *ihid = container_of(work, struct i2c_hid, pipe_work);
+	struct i2c_hid_pipe *pipe = READ_ONCE(ihid->pipe);
+	struct i2c_hid_pipe_slot *slot;
+	unsigned int tail;
 
-	size = i2c_hid_get_report_length(report);
-	if (i2c_hid_get_report(client,
-			report->type == HID_FEATURE_REPORT ? 0x03 : 0x01,
-			report->id, buffer, size))
+	if (!pipe)
 		return;
 
-	i2c_hid_dbg(ihid, "report (len=%d): %*ph\n", size, size, buffer);
+	/* pairs with the release of head in i2c_hid_pipe_push() */
+	for (tail = pipe->tail; tail != smp_load_acquire(&pipe->head); tail++) {
+		slot = &pipe->slots[tail & pipe->mask];
 
-	ret_size = buffer[0] | (buffer[1] << 8);
+		i2c_hid_set_input_timestamp(ihid, slot->irq_time);
+		hid_input_report(ihid->hid, HID_INPUT_REPORT, slot->data,
+				 slot->len, 1);
+		i2c_hid_set_input_timestamp(ihid, 0);
 
-	if (ret_size != size) {
-		dev_err(&client->dev, "error in %s size:%d / ret_size:%d\n",
-			__func__, size, ret_size);
-		return;
+		/* includes the time the report waited in the ring */
+		if (READ_ONCE(latency_stats))
+			i2c_hid_lat_record(ihid, I2C_HID_LAT_DECODE,
+					   slot->read_done, ktime_get());
+
+		smp_store_release(&pipe->tail, tail + 1);
 	}
+}
 
-	/* hid->driver_lock is held as we are in probe function,
+/*
+ * Returns 1 if an input report was read, 0 if the device had none and a
+ * negative error code if the read failed. @speculative is for drain and
+ * poll reads that did not see the interrupt line asserted and may well
+ * find nothing.
+ */
+static int i2c_hid_get_input(struct i2c_hid *ihid, bool speculative)
+{
+	int ret, ret_size;
+	int mode = READ_ONCE(read_mode);
+	int size = i2c_hid_input_size(ihid, mode);
+	bool lat = READ_ONCE(latency_stats);
+	bool recv_len;
+	ktime_t start, read_done;
+
+	/* empty reads have a length of 0, which RECV_LEN cannot read */
+	recv_len = mode == I2C_HID_READ_RECV_LEN && ihid->recv_len &&
+		   !speculative &&
+		   !test_bit(I2C_HID_RESET_PENDING, &ihid->flags);
+
+	start = ktime_get();
+	ret = i2c_hid_recv_input(ihid, size, recv_len);
+
+	/*
+	 * The adapter rejects a length byte of 0, which is what a device
+	 * initiated reset sends. The device keeps answering with an empty
+	 * report, read that the normal way.
+	 */
+	if (recv_len && ret == -EPROTO) {
+		recv_len = false;
+		ret = i2c_hid_recv_input(ihid, size, false);
+	}
+	read_done = ktime_get();
+
+	if (recv_len && ret > 0)
+		size = ret;
+
+	if (lat)
+		i2c_hid_lat_record(ihid, I2C_HID_LAT_BUS, start, read_done);
+
+	if (ret != size) {
+		if (ret < 0) {
+			i2c_hid_stat_inc(ihid, bus_errors);
+			trace_i2c_hid_get_input(ihid->client, size, 0, ret,
+						I2C_HID_INPUT_BUS_ERROR);
+			return ret;
+		}
+
+		i2c_hid_stat_add(ihid, bytes_read, ret);
+		i2c_hid_stat_inc(ihid, short_reads);
+		trace_i2c_hid_get_input(ihid->client, size, 0, ret,
+					I2C_HID_INPUT_SHORT);
+		dev_err(&ihid->client->dev, "%s: got %d data instead of %d\n",
+			__func__, ret, size);
+		return -EIO;
+	}
+
+	i2c_hid_stat_add(ihid, bytes_read, size);
+
+	ret_size = ihid->inbuf[0] | ihid->inbuf[1] << 8;
+
+	if (!ret_size) {
+		/* host initiated RESET completed */
+		if (test_and_clear_bit(I2C_HID_RESET_PENDING, &ihid->flags)) {
+			i2c_hid_stat_inc(ihid, resets);
+			trace_i2c_hid_get_input(ihid->client, size, ret_size,
+						ret, I2C_HID_INPUT_RESET);
+			wake_up(&ihid->wait);
+			return 0;
+		}
+
+		/*
+		 * Nothing queued for a drain or poll read, or a device
+		 * initiated reset, the two look the same.
+		 */
+		i2c_hid_stat_inc(ihid, empty_reads);
+		trace_i2c_hid_get_input(ihid->client, size, ret_size, ret,
+					I2C_HID_INPUT_EMPTY);
+		return 0;
+	}
+
+	if (ret_size > size) {
+		i2c_hid_stat_inc(ihid, incomplete);
+		trace_i2c_hid_get_input(ihid->client, size, ret_size, ret,
+					I2C_HID_INPUT_INCOMPLETE);
+		dev_err(&ihid->client->dev, "%s: incomplete report (%d/%d)\n",
+			__func__, size, ret_size);
+		/*
+		 * The device sends longer reports than its descriptor
+		 * declares, read at least that much from now on.
+		 */
+		if (mode != I2C_HID_READ_MAX && ihid->input_len &&
+		    ret_size > ihid->input_len) {
+			ihid->input_len = ret_size;
+			if (ret_size > I2C_SMBUS_BLOCK_MAX)
+				ihid->recv_len = false;
+		}
+		return -EIO;
+	}
+
+	i2c_hid_dbg_data(ihid, I2C_HID_DBG_INPUT, ihid->inbuf, ret_size);
+
+	if (ihid->rec)
+		i2c_hid_rec_add(ihid->rec, read_done, ihid->inbuf + 2,
+				ret_size - 2);
+
+	/* the device is not reset yet after an async resume */
+	if (!test_bit(I2C_HID_STARTED, &ihid->flags) ||
+	    test_bit(I2C_HID_RESUMING, &ihid->flags)) {
+		i2c_hid_stat_inc(ihid, dropped);
+		trace_i2c_hid_get_input(ihid->client, size, ret_size, ret,
+					I2C_HID_INPUT_DROPPED);
+		return 1;
+	}
+
+	if (ihid->pipe && !i2c_hid_pipe_push(ihid, ihid->pipe,
+			ihid->inbuf + 2, ret_size - 2, read_done)) {
+		trace_i2c_hid_get_input(ihid->client, size, ret_size, ret,
+					I2C_HID_INPUT_OVERFLOW);
+		return 1;
+	}
+
+	i2c_hid_stat_inc(ihid, frames);
+	trace_i2c_hid_get_input(ihid->client, size, ret_size, ret,
+				I2C_HID_INPUT_OK);
+
+	/* the pipeline worker passes it on */
+	if (ihid->pipe)
+		return 1;
+
+	i2c_hid_set_input_timestamp(ihid, ihid->irq_time);
+	hid_input_report(ihid->hid, HID_INPUT_REPORT, ihid->inbuf + 2,
+			ret_size - 2, 1);
+	i2c_hid_set_input_timestamp(ihid, 0);
+
+	if (lat)
+		i2c_hid_lat_record(ihid, I2C_HID_LAT_DECODE, read_done,
+				   ktime_get());
+
+	return 1;
+}
+
+/*
+ * The device keeps its interrupt line asserted while it has reports
+ * queued. Returns 1 if that is the case, 0 if not and a negative error
+ * code if the interrupt controller cannot read back the line.
+ */
+static int i2c_hid_input_pending(struct i2c_hid *ihid)
+{
+	unsigned int type = irq_get_trigger_type(ihid->client->irq);
+	bool high;
+	int ret;
+
+	if (ihid->polled)
+		return -ENODEV;
+
+	ret = irq_get_irqchip_state(ihid->client->irq,
+				    IRQCHIP_STATE_LINE_LEVEL, &high);
+	if (ret)
+		return ret;
+
+	if (type & (IRQ_TYPE_LEVEL_HIGH | IRQ_TYPE_EDGE_RISING))
+		return high;
+
+	return !high;
+}
+
+static irqreturn_t i2c_hid_irq_hard(int irq, void *dev_id)
+{
+	struct i2c_hid *ihid = dev_id;
+
+	ihid->irq_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Read the reports the device queued while we handled the first one, up to
+ * drain_budget per interrupt, instead of taking a new interrupt and thread
+ * wakeup for each. Without a readable line level an extra read finds out,
+ * a device without a report answers it with a zero length.
+ */
+static unsigned int i2c_hid_drain_input(struct i2c_hid *ihid)
+{
+	unsigned int budget = READ_ONCE(drain_budget);
+	unsigned int n;
+	int pending, ret;
+
+	for (n = 1; n < budget; n++) {
+		/* a command is waiting for the device, leave it the bus */
+		if (atomic_read(&ihid->reads_pending) ||
+		    test_bit(I2C_HID_RESET_PENDING, &ihid->flags))
+			break;
+
+		pending = i2c_hid_input_pending(ihid);
+		if (!pending)
+			break;
+
+		ihid->irq_time = ktime_get();
+
+		ret = i2c_hid_get_input(ihid, pending < 0);
+		if (ret <= 0) {
+			if (!ret)
+				i2c_hid_stat_inc(ihid, drain_empty);
+			break;
+		}
+
+		i2c_hid_stat_inc(ihid, drained);
+	}
+
+	return n - 1;
+}
+
+/*
+ * Like NAPI for network devices: a device that keeps reporting faster than
+ * poll_threshold_hz is read from a timer at its report interval with the
+ * interrupt disabled, which saves an interrupt and a thread wakeup per
+ * report. poll_idle_count empty polls in a row switch back to interrupts.
+ */
+static void i2c_hid_poll_start(struct i2c_hid *ihid, u64 interval_ns)
+{
+	unsigned int us = READ_ONCE(poll_interval_us);
+
+	if (us)
+		interval_ns = (u64)us * NSEC_PER_USEC;
+
+	ihid->poll_interval_ns = max_t(u64, interval_ns, 100 * NSEC_PER_USEC);
+	ihid->poll_idle = 0;
+	set_bit(I2C_HID_POLLING, &ihid->flags);
+	i2c_hid_stat_inc(ihid, poll_enter);
+
+	/* we are running in the IRQ thread, disable_irq() would deadlock */
+	disable_irq_nosync(ihid->client->irq);
+	hrtimer_start(&ihid->poll_timer, ns_to_ktime(ihid->poll_interval_ns),
+		      HRTIMER_MODE_REL);
+}
+
+static void i2c_hid_poll_stop(struct i2c_hid *ihid)
+{
+	if (!test_and_clear_bit(I2C_HID_POLLING, &ihid->flags))
+		return;
+
+	i2c_hid_stat_inc(ihid, poll_exit);
+	ihid->rate_reports = 0;
+	ihid->rate_start = ktime_get();
+	enable_irq(ihid->client->irq);
+}
+
+/*
+ * For suspend and removal. The caller disables the interrupt first, so the
+ * IRQ thread cannot start polling again behind our back. The interrupt stays
+ * disabled once, for the caller.
+ */
+static void i2c_hid_poll_cancel(struct i2c_hid *ihid)
+{
+	bool polling;
+
+	/*
+	 * The work tests the bit and re-arms the timer under input_lock, so
+	 * once it is cleared under the lock nothing arms the timer again.
+	 */
+	mutex_lock(&ihid->input_lock);
+	polling = test_and_clear_bit(I2C_HID_POLLING, &ihid->flags);
+	mutex_unlock(&ihid->input_lock);
+
+	hrtimer_cancel(&ihid->poll_timer);
+	cancel_work_sync(&ihid->poll_work);
+
+	if (polling && !ihid->polled) {
+		i2c_hid_stat_inc(ihid, poll_exit);
+		enable_irq(ihid->client->irq);
+	}
+}
+
+/* devices without a usable interrupt are polled all the time */
+static void i2c_hid_poll_begin(struct i2c_hid *ihid)
+{
+	ihid->poll_interval_ns = div_u64(NSEC_PER_SEC, max(poll_hz, 1U));
+	ihid->poll_idle = 0;
+	set_bit(I2C_HID_POLLING, &ihid->flags);
+	hrtimer_start(&ihid->poll_timer, ns_to_ktime(ihid->poll_interval_ns),
+		      HRTIMER_MODE_REL);
+}
+
+static u64 i2c_hid_poll_next(struct i2c_hid *ihid)
+{
+	if (!ihid->polled)
+		return ihid->poll_interval_ns;
+
+	return ihid->poll_interval_ns <<
+		min_t(unsigned int, ihid->poll_idle, I2C_HID_POLL_BACKOFF_SHIFT);
+}
+
+/* stop and restart input around suspend, whether IRQ or polling driven */
+static void i2c_hid_input_disable(struct i2c_hid *ihid)
+{
+	if (!ihid->polled)
+		disable_irq(ihid->client->irq);
+	i2c_hid_poll_cancel(ihid);
+}
+
+static void i2c_hid_input_enable(struct i2c_hid *ihid)
+{
+	if (ihid->polled)
+		i2c_hid_poll_begin(ihid);
+	else
+		enable_irq(ihid->client->irq);
+}
+
+/* called from the IRQ thread with the number of reports it just read */
+static void i2c_hid_poll_check(struct i2c_hid *ihid, unsigned int reports)
+{
+	unsigned int threshold = READ_ONCE(poll_threshold_hz);
+	u64 elapsed;
+
+	if (!threshold || !reports)
+		return;
+
+	ihid->rate_reports += reports;
+	elapsed = ktime_to_ns(ktime_sub(ihid->irq_time, ihid->rate_start));
+	if (elapsed < I2C_HID_RATE_WINDOW_NS)
+		return;
+
+	if ((u64)ihid->rate_reports * NSEC_PER_SEC >= (u64)threshold * elapsed)
+		i2c_hid_poll_start(ihid, div_u64(elapsed, ihid->rate_reports));
+
+	ihid->rate_start = ihid->irq_time;
+	ihid->rate_reports = 0;
+}
+
+static enum hrtimer_restart i2c_hid_poll_timer(struct hrtimer *timer)
+{
+	struct i2c_hid *ihid = container_of(timer, struct i2c_hid, poll_timer);
+
+	queue_work(system_highpri_wq, &ihid->poll_work);
+
+	return HRTIMER_NORESTART;
+}
+
+static void i2c_hid_poll_work(struct work_struct *work)
+{
+	struct i2c_hid *ihid = container_of(work, struct i2c_hid, poll_work);
+	int pending, ret = 0;
+
+	mutex_lock(&ihid->input_lock);
+
+	if (!test_bit(I2C_HID_POLLING, &ihid->flags))
+		goto out;
+
+	i2c_hid_stat_inc(ihid, polls);
+
+	/* a command is waiting for the device, try again next time */
+	if (atomic_read(&ihid->reads_pending))
+		goto rearm;
+
+	/*
+	 * With the interrupt disabled the reset sentinel is only seen here,
+	 * i2c_hid_get_input() clears I2C_HID_RESET_PENDING like the IRQ
+	 * thread does. Skip the bus read if the line says there is nothing.
+	 */
+	pending = i2c_hid_input_pending(ihid);
+	if (pending) {
+		ihid->irq_time = ktime_get();
+		ret = i2c_hid_get_input(ihid, pending < 0);
+		if (ret > 0)
+			i2c_hid_drain_input(ihid);
+	}
+
+	if (ret > 0) {
+		ihid->poll_idle = 0;
+	} else {
+		i2c_hid_stat_inc(ihid, polls_empty);
+		if (++ihid->poll_idle >= READ_ONCE(poll_idle_count) &&
+		    !ihid->polled) {
+			i2c_hid_poll_stop(ihid);
+			goto out;
+		}
+	}
+
+rearm:
+	hrtimer_start(&ihid->poll_timer, ns_to_ktime(i2c_hid_poll_next(ihid)),
+		      HRTIMER_MODE_REL);
+out:
+	mutex_unlock(&ihid->input_lock);
+}
+
+static const struct {
+	const char *name;
+	int policy;
+} i2c_hid_sched_policies[] = {
+	{ "fifo",	SCHED_FIFO },
+	{ "rr",		SCHED_RR },
+	{ "normal",	SCHED_NORMAL },
+};
+
+static const char *i2c_hid_sched_policy_name(int policy)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(i2c_hid_sched_policies); i++)
+		if (i2c_hid_sched_policies[i].policy == policy)
+			return i2c_hid_sched_policies[i].name;
+
+	return "unknown";
+}
+
+/*
+ * The IRQ thread is created by the IRQ core and its task is not exported,
+ * so the thread applies the configured scheduling to itself on its next
+ * run. Being a kernel thread it keeps it across suspend and resume.
+ */
+static void i2c_hid_irq_sched_apply(struct i2c_hid *ihid)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+	struct sched_attr attr = { .size = sizeof(attr) };
+#else
+	struct sched_param param = { 0 };
+#endif
+	int policy, prio, ret;
+
+	mutex_lock(&ihid->sched_lock);
+	policy = ihid->sched_policy;
+	prio = ihid->sched_prio;
+	ihid->sched_applied = ihid->sched_gen;
+	mutex_unlock(&ihid->sched_lock);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+	attr.sched_policy = policy;
+	if (policy == SCHED_NORMAL)
+		attr.sched_nice = prio;
+	else
+		attr.sched_priority = prio;
+	ret = sched_setattr_nocheck(current, &attr);
+#else
+	if (policy != SCHED_NORMAL)
+		param.sched_priority = prio;
+	ret = sched_setscheduler_nocheck(current, policy, &param);
+	if (!ret && policy == SCHED_NORMAL)
+		set_user_nice(current, prio);
+#endif
+	if (ret)
+		dev_warn(&ihid->client->dev,
+			 "failed to set the IRQ thread scheduling: %d\n", ret);
+
+	WRITE_ONCE(ihid->irq_pid, task_pid_nr(current));
+}
+
+/*
+ * IRQ threads follow the affinity of their interrupt, so setting that
+ * moves both the hard IRQ and the thread.
+ */
+static int i2c_hid_irq_affinity_apply(struct i2c_hid *ihid)
+{
+	if (ihid->polled || cpumask_empty(ihid->irq_cpus))
+		return 0;
+
+	return irq_set_affinity_hint(ihid->client->irq, ihid->irq_cpus);
+}
+
+static irqreturn_t i2c_hid_irq(int irq, void *dev_id)
+{
+	struct i2c_hid *ihid = dev_id;
+
+	if (unlikely(READ_ONCE(ihid->sched_gen) != ihid->sched_applied))
+		i2c_hid_irq_sched_apply(ihid);
+
+	if (READ_ONCE(latency_stats))
+		i2c_hid_lat_record(ihid, I2C_HID_LAT_SCHED, ihid->irq_time,
+				   ktime_get());
+
+	if (atomic_read(&ihid->reads_pending)) {
+		i2c_hid_stat_inc(ihid, irq_ignored);
+		return IRQ_HANDLED;
+	}
+
+	mutex_lock(&ihid->input_lock);
+
+	/* a report that raced with the switch to polling, the poll reads it */
+	if (test_bit(I2C_HID_POLLING, &ihid->flags))
+		goto out;
+
+	i2c_hid_stat_inc(ihid, irq_wakeups);
+
+	if (i2c_hid_get_input(ihid, false) > 0)
+		i2c_hid_poll_check(ihid, 1 + i2c_hid_drain_input(ihid));
+
+out:
+	mutex_unlock(&ihid->input_lock);
+	return IRQ_HANDLED;
+}
+
+static int i2c_hid_get_report_length(struct hid_report *report)
+{
+	return ((report->size - 1) >> 3) + 1 +
+		report->device->report_enum[report->type].numbered + 2;
+}
+
+/* returns the length of the report read into buffer, 0 on failure */
+static unsigned int i2c_hid_fetch_init_report(struct hid_report *report,
+	u8 *buffer)
+{
+	struct hid_device *hid = report->device;
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	unsigned int size, ret_size;
+
+	size = i2c_hid_get_report_length(report);
+	if (i2c_hid_get_report(client,
+			report->type == HID_FEATURE_REPORT ? 0x03 : 0x01,
+			report->id, buffer, size))
+		return 0;
+
+	i2c_hid_dbg(ihid, "report (len=%d): %*ph\n", size, size, buffer);
+
+	ret_size = buffer[0] | (buffer[1] << 8);
+
+	if (ret_size != size) {
+		dev_err(&client->dev, "error in %s size:%d / ret_size:%d\n",
+			__func__, size, ret_size);
+		return 0;
+	}
+
+	return size;
+}
+
+static void i2c_hid_init_report(struct hid_report *report, u8 *buffer,
+	size_t bufsize)
+{
+	unsigned int size = i2c_hid_fetch_init_report(report, buffer);
+
+	/* hid->driver_lock is held as we are in probe function,
 	 * we just need to setup the input fields, so using
 	 * hid_report_raw_event is safe. */
-	hid_report_raw_event(hid, report->type, buffer + 2, size - 2, 1);
+	if (size)
+		hid_report_raw_event(report->device, report->type, buffer + 2,
+				     size - 2, 1);
 }
 
 /*
- * Initialize all reports
+ * Drop a runtime PM reference. The device only goes to sleep once it has
+ * been unused for autosuspend_delay_ms, so quickly reopening it is free.
  */
-static void i2c_hid_init_reports(struct hid_device *hid)
+static void i2c_hid_pm_put(struct i2c_client *client)
+{
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+}
+
+/*
+ * By the time lazy_init_reports reads a report the device is connected, so
+ * hid_report_raw_event() would pass it to hidraw, hiddev, the input layer
+ * and the HID driver like an input report. Only the field values are
+ * wanted, store them the way hid_input_field() does.
+ */
+static void i2c_hid_init_values(struct hid_report *report, u8 *data)
+{
+	struct hid_device *hid = report->device;
+	struct hid_field *field;
+	unsigned int a, n;
+	u32 value;
+
+	if (hid->report_enum[report->type].numbered)
+		data++;
+
+	for (a = 0; a < report->maxfield; a++) {
+		field = report->field[a];
+
+		for (n = 0; n < field->report_count; n++) {
+			value = hid_field_extract(hid, data,
+					field->report_offset +
+					n * field->report_size,
+					field->report_size);
+			field->value[n] = field->logical_minimum < 0 ?
+				sign_extend32(value, field->report_size - 1) :
+				value;
+		}
+	}
+}
+
+/*
+ * lazy_init_reports: the reports are read without any lock, only storing
+ * their values needs driver_input_lock, which the input path holds too. It
+ * is only tried, because i2c_hid_stop() waits for this work while the HID
+ * core may hold it. If the HID driver is still probing, come back later.
+ */
+static void i2c_hid_init_work(struct work_struct *work)
 {
+	struct i2c_hid *ihid = container_of(to_delayed_work(work),
+					    struct i2c_hid, init_work);
+	struct hid_device *hid = ihid->hid;
 	struct hid_report *report;
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	u8 *inbuf = kzalloc(ihid->bufsize, GFP_KERNEL);
+	ktime_t start = ktime_get();
+	unsigned int size;
+	bool busy = false;
+	u8 *buf;
 
-	if (!inbuf) {
-		dev_err(&client->dev, "can not retrieve initial reports\n");
+	buf = i2c_hid_dma_alloc(ihid->bufsize);
+	if (!buf) {
+		dev_err(&ihid->client->dev, "can not retrieve initial reports\n");
 		return;
 	}
 
-	/*
-	 * The device must be powered on while we fetch initial reports
-	 * from it.
-	 */
-	pm_runtime_get_sync(&client->dev);
+	pm_runtime_get_sync(&ihid->client->dev);
+
+	list_for_each_entry(report,
+		&hid->report_enum[HID_FEATURE_REPORT].report_list, list) {
+		if (!test_bit(report->id, ihid->init_pending))
+			continue;
+
+		size = i2c_hid_fetch_init_report(report, buf);
+		clear_bit(report->id, ihid->init_pending);
+		if (!size)
+			continue;
+
+		if (down_trylock(&hid->driver_input_lock)) {
+			set_bit(report->id, ihid->init_pending);
+			busy = true;
+			break;
+		}
+		i2c_hid_init_values(report, buf + 2);
+		up(&hid->driver_input_lock);
+	}
+
+	i2c_hid_pm_put(ihid->client);
+	kfree(buf);
+
+	if (busy)
+		queue_delayed_work(system_long_wq, &ihid->init_work,
+				   msecs_to_jiffies(I2C_HID_INIT_RETRY_MS));
+	else
+		i2c_hid_boot_record(ihid, I2C_HID_BOOT_INIT, start);
+}
+
+/*
+ * Initialize all reports
+ */
+static void i2c_hid_init_reports(struct hid_device *hid)
+{
+	struct hid_report *report;
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	u8 *inbuf = i2c_hid_dma_alloc(ihid->bufsize);
+
+	if (!inbuf) {
+		dev_err(&client->dev, "can not retrieve initial reports\n");
+		return;
+	}
+
+	/*
+	 * The device must be powered on while we fetch initial reports
+	 * from it.
+	 */
+	pm_runtime_get_sync(&client->dev);
+
+	list_for_each_entry(report,
+		&hid->report_enum[HID_FEATURE_REPORT].report_list, list)
+		i2c_hid_init_report(report, inbuf, ihid->bufsize);
+
+	i2c_hid_pm_put(client);
+
+	kfree(inbuf);
+}
+
+/*
+ * Traverse the supplied list of reports and find the longest
+ */
+static void i2c_hid_find_max_report(struct hid_device *hid, unsigned int type,
+		unsigned int *max)
+{
+	struct hid_report *report;
+	unsigned int size;
+
+	/* We should not rely on wMaxInputLength, as some devices may set it to
+	 * a wrong length. */
+	list_for_each_entry(report, &hid->report_enum[type].report_list, list) {
+		size = i2c_hid_get_report_length(report);
+		if (*max < size)
+			*max = size;
+	}
+}
+
+static void i2c_hid_free_buffers(struct i2c_hid *ihid)
+{
+	unsigned int i;
+
+	kfree(ihid->inbuf);
+	kfree(ihid->argsbuf);
+	kfree(ihid->cmdbuf);
+	ihid->inbuf = NULL;
+	ihid->cmdbuf = NULL;
+	ihid->argsbuf = NULL;
+
+	for (i = 0; i < ihid->nr_reqs; i++) {
+		kfree(ihid->req_buf[i]);
+		ihid->req_buf[i] = NULL;
+	}
+	ihid->nr_reqs = 0;
+	ihid->req_free = 0;
+
+	ihid->bufsize = 0;
+}
+
+static int i2c_hid_alloc_buffers(struct i2c_hid *ihid, size_t report_size)
+{
+	/* the worst case is computed from the set_report command with a
+	 * reportID > 15 and the maximum report length */
+	int args_len = sizeof(__u8) + /* optional ReportID byte */
+		       sizeof(__u16) + /* data register */
+		       sizeof(__u16) + /* size of the report */
+		       report_size; /* report */
+	unsigned int i;
+
+	ihid->inbuf = i2c_hid_dma_alloc(report_size);
+	ihid->argsbuf = i2c_hid_dma_alloc(args_len);
+	ihid->cmdbuf = i2c_hid_dma_alloc(sizeof(union command) + args_len);
+
+	ihid->nr_reqs = clamp_t(unsigned int, request_slots, 1,
+				I2C_HID_MAX_REQS);
+	for (i = 0; i < ihid->nr_reqs; i++) {
+		ihid->req_buf[i] = i2c_hid_dma_alloc(report_size);
+		if (!ihid->req_buf[i])
+			break;
+	}
+
+	if (!ihid->inbuf || !ihid->argsbuf || !ihid->cmdbuf ||
+	    i < ihid->nr_reqs) {
+		i2c_hid_free_buffers(ihid);
+		return -ENOMEM;
+	}
+
+	ihid->req_free = GENMASK(ihid->nr_reqs - 1, 0);
+	ihid->bufsize = report_size;
+
+	return 0;
+}
+
+static unsigned int i2c_hid_feature_ttl(struct i2c_hid_feature *feature)
+{
+	return feature->ttl_ms < 0 ? READ_ONCE(feature_cache_ms) :
+				     feature->ttl_ms;
+}
+
+/* called with feature_lock held, returns the bytes copied or 0 on a miss */
+static size_t i2c_hid_feature_get(struct i2c_hid *ihid, u8 id, u8 *buf,
+		size_t count)
+{
+	struct i2c_hid_feature *feature = &ihid->features[id];
+	s64 age;
+
+	if (!feature->len)
+		return 0;
+
+	age = ktime_ms_delta(ktime_get(), feature->time);
+	if (age >= i2c_hid_feature_ttl(feature))
+		return 0;
+
+	count = min_t(size_t, count, feature->len);
+	memcpy(buf, feature->data, count);
+	return count;
+}
+
+/*
+ * Called with feature_lock held. The lock is not held during the read, a
+ * reply is dropped if the report was set or the device reset meanwhile.
+ */
+static void i2c_hid_feature_put(struct i2c_hid *ihid, u8 id, unsigned int gen,
+		const u8 *buf, size_t count)
+{
+	struct i2c_hid_feature *feature = &ihid->features[id];
+
+	if (feature->gen != gen)
+		return;
+
+	if (feature->len < count) {
+		kfree(feature->data);
+		feature->len = 0;
+		feature->data = kmalloc(count, GFP_KERNEL);
+		if (!feature->data)
+			return;
+	}
+
+	memcpy(feature->data, buf, count);
+	feature->len = count;
+	feature->time = ktime_get();
+}
+
+static int i2c_hid_req_take(struct i2c_hid *ihid)
+{
+	unsigned int i;
+
+	for (i = 0; i < ihid->nr_reqs; i++)
+		if (test_and_clear_bit(i, &ihid->req_free))
+			return i;
+
+	return -EBUSY;
+}
+
+/*
+ * Get one of the request_slots reply buffers, so that concurrent
+ * GET_REPORTs don't share one. Returns its index.
+ */
+static int i2c_hid_req_get(struct i2c_hid *ihid)
+{
+	int req, ret;
+
+	req = i2c_hid_req_take(ihid);
+	if (req >= 0)
+		return req;
+
+	i2c_hid_stat_inc(ihid, req_waits);
+	ret = wait_event_killable(ihid->req_wait,
+				  (req = i2c_hid_req_take(ihid)) >= 0);
+
+	return ret ? ret : req;
+}
+
+static void i2c_hid_req_put(struct i2c_hid *ihid, int req)
+{
+	set_bit(req, &ihid->req_free);
+	smp_mb__after_atomic();
+	wake_up(&ihid->req_wait);
+}
+
+static int i2c_hid_get_raw_report(struct hid_device *hid,
+		unsigned char report_number, __u8 *buf, size_t count,
+		unsigned char report_type)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	size_t ret_count, ask_count;
+	bool cache = false;
+	unsigned int gen = 0;
+	u8 *reply;
+	int ret, req;
+
+	if (report_type == HID_OUTPUT_REPORT)
+		return -EINVAL;
+
+	if (report_type == HID_FEATURE_REPORT &&
+	    i2c_hid_feature_ttl(&ihid->features[report_number])) {
+		mutex_lock(&ihid->feature_lock);
+		ret = i2c_hid_feature_get(ihid, report_number, buf, count);
+		gen = ihid->features[report_number].gen;
+		mutex_unlock(&ihid->feature_lock);
+
+		if (ret) {
+			i2c_hid_stat_inc(ihid, feature_hits);
+			return ret;
+		}
+		i2c_hid_stat_inc(ihid, feature_misses);
+		cache = true;
+	}
+
+	req = i2c_hid_req_get(ihid);
+	if (req < 0)
+		return req;
+	reply = ihid->req_buf[req];
+
+	/* +2 bytes to include the size of the reply in the query buffer */
+	ask_count = min(count + 2, (size_t)ihid->bufsize);
+
+	ret = i2c_hid_get_report(client,
+			report_type == HID_FEATURE_REPORT ? 0x03 : 0x01,
+			report_number, reply, ask_count);
+
+	if (ret < 0)
+		goto out;
+
+	ret_count = reply[0] | (reply[1] << 8);
+
+	if (ret_count <= 2) {
+		ret = 0;
+		goto out;
+	}
+
+	/* only whole reports are cached, later reads may ask for more */
+	if (cache && ret_count <= ask_count) {
+		mutex_lock(&ihid->feature_lock);
+		i2c_hid_feature_put(ihid, report_number, gen, reply + 2,
+				    ret_count - 2);
+		mutex_unlock(&ihid->feature_lock);
+	}
+
+	ret_count = min(ret_count, ask_count);
+
+	/* The query buffer contains the size, dropping it in the reply */
+	count = min(count, ret_count - 2);
+	memcpy(buf, reply + 2, count);
+	ret = count;
+
+out:
+	i2c_hid_req_put(ihid, req);
+	return ret;
+}
+
+static int i2c_hid_output_raw_report(struct hid_device *hid, __u8 *buf,
+		size_t count, unsigned char report_type, bool use_data)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	int report_id = buf[0];
+	int ret;
+
+	if (report_type == HID_INPUT_REPORT)
+		return -EINVAL;
+
+	if (report_type == HID_FEATURE_REPORT)
+		i2c_hid_feature_invalidate(ihid, report_id);
+
+	mutex_lock(&ihid->reset_lock);
+
+	if (report_id) {
+		buf++;
+		count--;
+	}
+
+	ret = i2c_hid_set_or_send_report(client,
+				report_type == HID_FEATURE_REPORT ? 0x03 : 0x02,
+				report_id, buf, count, use_data);
+
+	if (report_id && ret >= 0)
+		ret++; /* add report_id to the number of transfered bytes */
+
+	mutex_unlock(&ihid->reset_lock);
+
+	/* a GET_REPORT racing with the write may have cached the old value */
+	if (report_type == HID_FEATURE_REPORT && ret >= 0)
+		i2c_hid_feature_invalidate(ihid, report_id);
+
+	return ret;
+}
+
+static int i2c_hid_output_report(struct hid_device *hid, __u8 *buf,
+		size_t count)
+{
+	return i2c_hid_output_raw_report(hid, buf, count, HID_OUTPUT_REPORT,
+			false);
+}
+
+static int i2c_hid_raw_request(struct hid_device *hid, unsigned char reportnum,
+			       __u8 *buf, size_t len, unsigned char rtype,
+			       int reqtype)
+{
+	switch (reqtype) {
+	case HID_REQ_GET_REPORT:
+		return i2c_hid_get_raw_report(hid, reportnum, buf, len, rtype);
+	case HID_REQ_SET_REPORT:
+		if (buf[0] != reportnum)
+			return -EINVAL;
+		return i2c_hid_output_raw_report(hid, buf, len, rtype, true);
+	default:
+		return -EIO;
+	}
+}
+
+static struct i2c_hid_rdesc_entry *i2c_hid_rdesc_find(
+		const struct i2c_hid_desc *hdesc)
+{
+	struct i2c_hid_rdesc_entry *entry;
+
+	list_for_each_entry(entry, &i2c_hid_rdesc_list, list)
+		if (!memcmp(&entry->hdesc, hdesc, sizeof(*hdesc)))
+			return entry;
+
+	return NULL;
+}
+
+static void i2c_hid_rdesc_store(struct i2c_hid *ihid, const u8 *rdesc,
+		unsigned int size)
+{
+	struct i2c_hid_rdesc_entry *entry;
+	u8 *data;
+
+	data = kmemdup(rdesc, size, GFP_KERNEL);
+	if (!data)
+		return;
+
+	mutex_lock(&i2c_hid_rdesc_lock);
+	entry = i2c_hid_rdesc_find(&ihid->hdesc);
+	if (!entry) {
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry) {
+			mutex_unlock(&i2c_hid_rdesc_lock);
+			kfree(data);
+			return;
+		}
+		entry->hdesc = ihid->hdesc;
+		list_add(&entry->list, &i2c_hid_rdesc_list);
+	}
+	kfree(entry->data);
+	entry->data = data;
+	mutex_unlock(&i2c_hid_rdesc_lock);
+}
+
+static void i2c_hid_rdesc_free_all(void)
+{
+	struct i2c_hid_rdesc_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &i2c_hid_rdesc_list, list) {
+		list_del(&entry->list);
+		kfree(entry->data);
+		kfree(entry);
+	}
+}
+
+/* a descriptor shipped as i2c-hid/rdesc-<vendor>-<product>-<version>.bin */
+static bool i2c_hid_rdesc_firmware(struct i2c_hid *ihid, u8 *rdesc,
+		unsigned int size)
+{
+	const struct firmware *fw;
+	char name[48];
+	bool found;
+
+	snprintf(name, sizeof(name), "i2c-hid/rdesc-%04x-%04x-%04x.bin",
+		 le16_to_cpu(ihid->hdesc.wVendorID),
+		 le16_to_cpu(ihid->hdesc.wProductID),
+		 le16_to_cpu(ihid->hdesc.wVersionID));
+
+	if (request_firmware_direct(&fw, name, &ihid->client->dev))
+		return false;
+
+	found = fw->size == size;
+	if (found)
+		memcpy(rdesc, fw->data, size);
+	else
+		dev_warn(&ihid->client->dev, "%s has %zu bytes instead of %u\n",
+			 name, fw->size, size);
+
+	release_firmware(fw);
+	return found;
+}
+
+/*
+ * Fill rdesc from the cache or a firmware file. The length is part of the
+ * key, the start of the descriptor is compared with a short read from the
+ * device to catch firmware updates that kept the version.
+ */
+static bool i2c_hid_rdesc_lookup(struct i2c_hid *ihid, u8 *rdesc,
+		unsigned int size)
+{
+	unsigned int check = min_t(unsigned int, size, I2C_HID_RDESC_CHECK_LEN);
+	struct i2c_hid_rdesc_entry *entry;
+	bool cached, found, stale;
+	int req;
+
+	if (!READ_ONCE(rdesc_cache))
+		return false;
+
+	mutex_lock(&i2c_hid_rdesc_lock);
+	entry = i2c_hid_rdesc_find(&ihid->hdesc);
+	cached = entry && entry->data;
+	if (cached)
+		memcpy(rdesc, entry->data, size);
+	mutex_unlock(&i2c_hid_rdesc_lock);
+
+	found = cached || i2c_hid_rdesc_firmware(ihid, rdesc, size);
+	if (!found)
+		return false;
+
+	req = i2c_hid_req_get(ihid);
+	if (req < 0)
+		return false;
+
+	/* the buffers hold at least HID_MIN_BUFFER_SIZE bytes */
+	stale = i2c_hid_command(ihid->client, &hid_report_descr_cmd,
+				ihid->req_buf[req], check) ||
+		memcmp(ihid->req_buf[req], rdesc, check);
+	i2c_hid_req_put(ihid, req);
+
+	if (stale) {
+		i2c_hid_stat_inc(ihid, rdesc_stale);
+		return false;
+	}
+
+	if (!cached)
+		i2c_hid_rdesc_store(ihid, rdesc, size);
+
+	return true;
+}
+
+static int i2c_hid_parse(struct hid_device *hid)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	struct i2c_hid_desc *hdesc = &ihid->hdesc;
+	unsigned int rsize;
+	char *rdesc;
+	int ret;
+	int tries = 3;
+	ktime_t start;
+
+	i2c_hid_dbg(ihid, "entering %s\n", __func__);
+
+	rsize = le16_to_cpu(hdesc->wReportDescLength);
+	if (!rsize || rsize > HID_MAX_DESCRIPTOR_SIZE) {
+		dbg_hid("weird size of report descriptor (%u)\n", rsize);
+		return -EINVAL;
+	}
+
+	start = ktime_get();
+	ihid->boot_resets = 0;
+	do {
+		ihid->boot_resets++;
+		ret = i2c_hid_hwreset(client);
+		if (ret)
+			msleep(1000);
+	} while (tries-- > 0 && ret);
+
+	start = i2c_hid_boot_record(ihid, I2C_HID_BOOT_RESET, start);
+	if (ret)
+		return ret;
+
+	rdesc = i2c_hid_dma_alloc(rsize);
+
+	if (!rdesc) {
+		dbg_hid("couldn't allocate rdesc memory\n");
+		return -ENOMEM;
+	}
+
+	if (i2c_hid_rdesc_lookup(ihid, rdesc, rsize)) {
+		i2c_hid_stat_inc(ihid, rdesc_hits);
+		i2c_hid_dbg(ihid, "using the cached HID report descriptor\n");
+	} else {
+		i2c_hid_stat_inc(ihid, rdesc_misses);
+		i2c_hid_dbg(ihid, "asking HID report descriptor\n");
+
+		ret = i2c_hid_command(client, &hid_report_descr_cmd, rdesc,
+				      rsize);
+		if (ret) {
+			hid_err(hid, "reading report descriptor failed\n");
+			kfree(rdesc);
+			return -EIO;
+		}
+
+		if (READ_ONCE(rdesc_cache))
+			i2c_hid_rdesc_store(ihid, rdesc, rsize);
+	}
+	start = i2c_hid_boot_record(ihid, I2C_HID_BOOT_RDESC, start);
+
+	i2c_hid_dbg(ihid, "Report Descriptor: %*ph\n", rsize, rdesc);
+
+	ret = hid_parse_report(hid, rdesc, rsize);
+	i2c_hid_boot_record(ihid, I2C_HID_BOOT_PARSE, start);
+	kfree(rdesc);
+	if (ret) {
+		dbg_hid("parsing report descriptor failed\n");
+		return ret;
+	}
+
+	return 0;
+}
+
+static int i2c_hid_start(struct hid_device *hid)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	int ret = 0;
+	unsigned int bufsize = HID_MIN_BUFFER_SIZE;
+
+	i2c_hid_find_max_report(hid, HID_INPUT_REPORT, &bufsize);
+	i2c_hid_find_max_report(hid, HID_OUTPUT_REPORT, &bufsize);
+	i2c_hid_find_max_report(hid, HID_FEATURE_REPORT, &bufsize);
+
+	/*
+	 * Polling and the IRQ thread may already be reading input into
+	 * inbuf, they hold input_lock while doing so.
+	 */
+	mutex_lock(&ihid->input_lock);
+
+	ihid->input_len = 0;
+	i2c_hid_find_max_report(hid, HID_INPUT_REPORT, &ihid->input_len);
+	ihid->recv_len = ihid->input_len &&
+			 ihid->input_len <= I2C_SMBUS_BLOCK_MAX &&
+			 i2c_check_functionality(client->adapter,
+					I2C_FUNC_SMBUS_READ_BLOCK_DATA);
+
+	if (bufsize > ihid->bufsize) {
+		i2c_hid_free_buffers(ihid);
+
+		ret = i2c_hid_alloc_buffers(ihid, bufsize);
+
+		/* input keeps being read, it needs a buffer in any case */
+		if (ret)
+			i2c_hid_alloc_buffers(ihid, HID_MIN_BUFFER_SIZE);
+	}
+
+	mutex_unlock(&ihid->input_lock);
+
+	if (ret)
+		return ret;
+
+	if (pipeline_slots) {
+		struct i2c_hid_pipe *pipe;
+
+		pipe = i2c_hid_pipe_alloc(pipeline_slots, ihid->bufsize);
+		if (!pipe)
+			return -ENOMEM;
+
+		mutex_lock(&ihid->input_lock);
+		WRITE_ONCE(ihid->pipe, pipe);
+		mutex_unlock(&ihid->input_lock);
+	}
+
+	if (hid->quirks & HID_QUIRK_NO_INIT_REPORTS)
+		return 0;
+
+	if (READ_ONCE(lazy_init_reports)) {
+		struct hid_report *report;
+
+		list_for_each_entry(report,
+			&hid->report_enum[HID_FEATURE_REPORT].report_list, list)
+			set_bit(report->id, ihid->init_pending);
+		queue_delayed_work(system_long_wq, &ihid->init_work, 0);
+	} else {
+		ktime_t start = ktime_get();
+
+		i2c_hid_init_reports(hid);
+		i2c_hid_boot_record(ihid, I2C_HID_BOOT_INIT, start);
+	}
+
+	return 0;
+}
+
+static void i2c_hid_stop(struct hid_device *hid)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	struct i2c_hid_pipe *pipe;
+
+	hid->claimed = 0;
+
+	cancel_delayed_work_sync(&ihid->init_work);
+	bitmap_zero(ihid->init_pending, HID_MAX_IDS);
+
+	mutex_lock(&ihid->input_lock);
+	pipe = ihid->pipe;
+	WRITE_ONCE(ihid->pipe, NULL);
+	mutex_unlock(&ihid->input_lock);
+
+	cancel_work_sync(&ihid->pipe_work);
+	i2c_hid_pipe_free(pipe);
+}
+
+static int i2c_hid_open(struct hid_device *hid)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	int ret = 0;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+	mutex_lock(&i2c_hid_open_mut);
+	if (!hid->open++) {
+		ret = pm_runtime_get_sync(&client->dev);
+		if (ret < 0) {
+			hid->open--;
+			goto done;
+		}
+		set_bit(I2C_HID_STARTED, &ihid->flags);
+	}
+done:
+	mutex_unlock(&i2c_hid_open_mut);
+	return ret < 0 ? ret : 0;
+#else
+	ret = pm_runtime_get_sync(&client->dev);
+	if (ret < 0)
+		return ret;
+
+	set_bit(I2C_HID_STARTED, &ihid->flags);
+	return 0;
+#endif
+
+}
+
+static void i2c_hid_close(struct hid_device *hid)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+	/* protecting hid->open to make sure we don't restart
+	 * data acquistion due to a resumption we no longer
+	 * care about
+	 */
+	mutex_lock(&i2c_hid_open_mut);
+	if (!--hid->open) {
+		clear_bit(I2C_HID_STARTED, &ihid->flags);
+
+		/* Save some power */
+		i2c_hid_pm_put(client);
+	}
+	mutex_unlock(&i2c_hid_open_mut);
+#else
+	clear_bit(I2C_HID_STARTED, &ihid->flags);
+
+	/* Save some power */
+	i2c_hid_pm_put(client);
+#endif
+}
+
+static int i2c_hid_power(struct hid_device *hid, int lvl)
+{
+	struct i2c_client *client = hid->driver_data;
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+
+	i2c_hid_dbg(ihid, "%s lvl:%d\n", __func__, lvl);
+
+	switch (lvl) {
+	case PM_HINT_FULLON:
+		pm_runtime_get_sync(&client->dev);
+		break;
+	case PM_HINT_NORMAL:
+		i2c_hid_pm_put(client);
+		break;
+	}
+	return 0;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
+static struct hid_ll_driver i2c_hid_ll_driver = {
+#else
+struct hid_ll_driver i2c_hid_ll_driver = {
+#endif
+	.parse = i2c_hid_parse,
+	.start = i2c_hid_start,
+	.stop = i2c_hid_stop,
+	.open = i2c_hid_open,
+	.close = i2c_hid_close,
+	.power = i2c_hid_power,
+	.output_report = i2c_hid_output_report,
+	.raw_request = i2c_hid_raw_request,
+};
+
+static void i2c_hid_irq_sched_init(struct i2c_hid *ihid)
+{
+	struct device *dev = &ihid->client->dev;
+	int ret;
+
+	if (irq_priority > 0 && irq_priority < MAX_RT_PRIO) {
+		ihid->sched_prio = irq_priority;
+		ihid->sched_gen++;
+	}
+
+	if (irq_cpus && cpulist_parse(irq_cpus, ihid->irq_cpus)) {
+		dev_warn(dev, "invalid irq_cpus '%s'\n", irq_cpus);
+		cpumask_clear(ihid->irq_cpus);
+	}
+
+	ret = i2c_hid_irq_affinity_apply(ihid);
+	if (ret)
+		dev_warn(dev, "failed to set the IRQ affinity: %d\n", ret);
+}
+
+static void i2c_hid_free_irq(struct i2c_hid *ihid)
+{
+	/* free_irq() complains about a hint left behind */
+	irq_set_affinity_hint(ihid->client->irq, NULL);
+	free_irq(ihid->client->irq, ihid);
+}
+
+static int i2c_hid_init_irq(struct i2c_client *client)
+{
+	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	unsigned long irqflags = 0;
+	int ret;
+
+	dev_dbg(&client->dev, "Requesting IRQ: %d\n", client->irq);
+
+	if (!irq_get_trigger_type(client->irq))
+		irqflags = IRQF_TRIGGER_LOW;
+
+	ret = request_threaded_irq(client->irq, i2c_hid_irq_hard, i2c_hid_irq,
+				   irqflags | IRQF_ONESHOT, client->name, ihid);
+	if (ret < 0) {
+		dev_warn(&client->dev,
+			"Could not register for %s interrupt, irq = %d,"
+			" ret = %d\n",
+			client->name, client->irq, ret);
+
+		return ret;
+	}
+
+	return 0;
+}
+
+static int i2c_hid_fetch_hid_descriptor(struct i2c_hid *ihid)
+{
+	struct i2c_client *client = ihid->client;
+	struct i2c_hid_desc *hdesc = &ihid->hdesc;
+	unsigned int dsize;
+	int ret;
+
+	/* i2c hid fetch using a fixed descriptor size (30 bytes) */
+	i2c_hid_dbg(ihid, "Fetching the HID descriptor\n");
+	ret = i2c_hid_command(client, &hid_descr_cmd, ihid->hdesc_buffer,
+				sizeof(struct i2c_hid_desc));
+	if (ret) {
+		dev_err(&client->dev, "hid_descr_cmd failed\n");
+		return -ENODEV;
+	}
+
+	/* Validate the length of HID descriptor, the 4 first bytes:
+	 * bytes 0-1 -> length
+	 * bytes 2-3 -> bcdVersion (has to be 1.00) */
+	/* check bcdVersion == 1.0 */
+	if (le16_to_cpu(hdesc->bcdVersion) != 0x0100) {
+		dev_err(&client->dev,
+			"unexpected HID descriptor bcdVersion (0x%04hx)\n",
+			le16_to_cpu(hdesc->bcdVersion));
+		return -ENODEV;
+	}
+
+	/* Descriptor length should be 30 bytes as per the specification */
+	dsize = le16_to_cpu(hdesc->wHIDDescLength);
+	if (dsize != sizeof(struct i2c_hid_desc)) {
+		dev_err(&client->dev, "weird size of HID descriptor (%u)\n",
+			dsize);
+		return -ENODEV;
+	}
+	i2c_hid_dbg(ihid, "HID Descriptor: %*ph\n", dsize, ihid->hdesc_buffer);
+	return 0;
+}
+
+#ifdef CONFIG_ACPI
+static int i2c_hid_acpi_pdata(struct i2c_client *client,
+		struct i2c_hid_platform_data *pdata)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+	static u8 i2c_hid_guid[] = {
+		0xF7, 0xF6, 0xDF, 0x3C, 0x67, 0x42, 0x55, 0x45,
+		0xAD, 0x05, 0xB3, 0x0A, 0x3D, 0x89, 0x38, 0xDE,
+	};
+#else
+	static guid_t i2c_hid_guid =
+		GUID_INIT(0x3CDFF6F7, 0x4267, 0x4555,
+			  0xAD, 0x05, 0xB3, 0x0A, 0x3D, 0x89, 0x38, 0xDE);
+#endif
+	union acpi_object *obj;
+	struct acpi_device *adev;
+	acpi_handle handle;
+
+	handle = ACPI_HANDLE(&client->dev);
+	if (!handle || acpi_bus_get_device(handle, &adev))
+		return -ENODEV;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+	obj = acpi_evaluate_dsm_typed(handle, i2c_hid_guid, 1, 1, NULL,
+				      ACPI_TYPE_INTEGER);
+#else
+	obj = acpi_evaluate_dsm_typed(handle, &i2c_hid_guid, 1, 1, NULL,
+				      ACPI_TYPE_INTEGER);
+#endif
+	if (!obj) {
+		dev_err(&client->dev, "device _DSM execution failed\n");
+		return -ENODEV;
+	}
+
+	pdata->hid_descriptor_address = obj->integer.value;
+	ACPI_FREE(obj);
+
+	return 0;
+}
+
+static const struct acpi_device_id i2c_hid_acpi_match[] = {
+	{"ACPI0C50", 0 },
+	{"PNP0C50", 0 },
+	{ },
+};
+MODULE_DEVICE_TABLE(acpi, i2c_hid_acpi_match);
+#else
+static inline int i2c_hid_acpi_pdata(struct i2c_client *client,
+		struct i2c_hid_platform_data *pdata)
+{
+	return -ENODEV;
+}
+#endif
+
+#ifdef CONFIG_OF
+static int i2c_hid_of_probe(struct i2c_client *client,
+		struct i2c_hid_platform_data *pdata)
+{
+	struct device *dev = &client->dev;
+	u32 val;
+	int ret;
+
+	ret = of_property_read_u32(dev->of_node, "hid-descr-addr", &val);
+	if (ret) {
+		dev_err(&client->dev, "HID register address not provided\n");
+		return -ENODEV;
+	}
+	if (val >> 16) {
+		dev_err(&client->dev, "Bad HID register address: 0x%08x\n",
+			val);
+		return -EINVAL;
+	}
+	pdata->hid_descriptor_address = val;
+
+	return 0;
+}
+
+static const struct of_device_id i2c_hid_of_match[] = {
+	{ .compatible = "hid-over-i2c" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, i2c_hid_of_match);
+#else
+static inline int i2c_hid_of_probe(struct i2c_client *client,
+		struct i2c_hid_platform_data *pdata)
+{
+	return -ENODEV;
+}
+#endif
+
+static int i2c_hid_latency_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid *ihid = m->private;
+	u64 count[I2C_HID_LAT_STAGES];
+	int bucket, stage, cpu;
+	bool empty;
+
+	seq_printf(m, "%-12s", "#ns");
+	for (stage = 0; stage < I2C_HID_LAT_STAGES; stage++)
+		seq_printf(m, " %12s", i2c_hid_lat_names[stage]);
+	seq_putc(m, '\n');
+
+	for (bucket = 0; bucket < I2C_HID_LAT_BUCKETS; bucket++) {
+		memset(count, 0, sizeof(count));
+		empty = true;
+
+		for_each_possible_cpu(cpu) {
+			struct i2c_hid_lat_hist *hist = per_cpu_ptr(ihid->lat, cpu);
+
+			for (stage = 0; stage < I2C_HID_LAT_STAGES; stage++)
+				count[stage] += hist->buckets[stage][bucket];
+		}
+
+		for (stage = 0; stage < I2C_HID_LAT_STAGES; stage++)
+			if (count[stage])
+				empty = false;
+		if (empty)
+			continue;
+
+		seq_printf(m, "%-12llu", 1ULL << bucket);
+		for (stage = 0; stage < I2C_HID_LAT_STAGES; stage++)
+			seq_printf(m, " %12llu", count[stage]);
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int i2c_hid_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, i2c_hid_latency_show, inode->i_private);
+}
+
+static const struct file_operations i2c_hid_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Any write clears the histograms. Concurrent updates on other CPUs may
+ * survive the reset, which is fine for statistics.
+ */
+static ssize_t i2c_hid_latency_reset_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct i2c_hid *ihid = file->private_data;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ihid->lat, cpu), 0,
+		       sizeof(struct i2c_hid_lat_hist));
+
+	return count;
+}
+
+static const struct file_operations i2c_hid_latency_reset_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.write		= i2c_hid_latency_reset_write,
+	.llseek		= noop_llseek,
+};
+
+static struct i2c_hid_recorder *i2c_hid_rec_alloc(unsigned int nr_slots)
+{
+	struct i2c_hid_recorder *rec;
+
+	rec = kzalloc(sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return NULL;
+
+	nr_slots = roundup_pow_of_two(min(nr_slots, I2C_HID_REC_MAX_SLOTS));
+	rec->size = PAGE_ALIGN(sizeof(*rec->hdr) +
+			       nr_slots * sizeof(struct i2c_hid_rec_slot));
+	rec->hdr = vmalloc_user(rec->size);
+	if (!rec->hdr) {
+		kfree(rec);
+		return NULL;
+	}
+
+	kref_init(&rec->ref);
+	rec->slots = (struct i2c_hid_rec_slot *)(rec->hdr + 1);
+	rec->mask = nr_slots - 1;
+
+	rec->hdr->magic = I2C_HID_REC_MAGIC;
+	rec->hdr->version = I2C_HID_REC_VERSION;
+	rec->hdr->slot_size = sizeof(struct i2c_hid_rec_slot);
+	rec->hdr->nr_slots = nr_slots;
+
+	return rec;
+}
+
+static void i2c_hid_rec_release(struct kref *ref)
+{
+	struct i2c_hid_recorder *rec =
+		container_of(ref, struct i2c_hid_recorder, ref);
+
+	vfree(rec->hdr);
+	kfree(rec);
+}
+
+static void i2c_hid_rec_put(struct i2c_hid_recorder *rec)
+{
+	if (rec)
+		kref_put(&rec->ref, i2c_hid_rec_release);
+}
+
+static ssize_t i2c_hid_recorder_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct i2c_hid *ihid = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, ihid->rec->hdr,
+				       ihid->rec->size);
+}
+
+static void i2c_hid_recorder_vm_open(struct vm_area_struct *vma)
+{
+	struct i2c_hid_recorder *rec = vma->vm_private_data;
+
+	kref_get(&rec->ref);
+}
+
+static void i2c_hid_recorder_vm_close(struct vm_area_struct *vma)
+{
+	i2c_hid_rec_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct i2c_hid_recorder_vm_ops = {
+	.open	= i2c_hid_recorder_vm_open,
+	.close	= i2c_hid_recorder_vm_close,
+};
+
+static int i2c_hid_recorder_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct i2c_hid *ihid = file->private_data;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
 
-	list_for_each_entry(report,
-		&hid->report_enum[HID_FEATURE_REPORT].report_list, list)
-		i2c_hid_init_report(report, inbuf, ihid->bufsize);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	ret = remap_vmalloc_range(vma, ihid->rec->hdr, vma->vm_pgoff);
+	if (ret)
+		return ret;
 
-	pm_runtime_put(&client->dev);
+	vma->vm_private_data = ihid->rec;
+	vma->vm_ops = &i2c_hid_recorder_vm_ops;
+	i2c_hid_recorder_vm_open(vma);
 
-	kfree(inbuf);
+	return 0;
 }
 
+static const struct file_operations i2c_hid_recorder_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.read		= i2c_hid_recorder_read,
+	.mmap		= i2c_hid_recorder_mmap,
+	.llseek		= default_llseek,
+};
+
 /*
- * Traverse the supplied list of reports and find the longest
+ * The report descriptor as the device sent it, before any report_fixup of
+ * the HID driver, for seeding /lib/firmware/i2c-hid/. Only the rdesc
+ * cache keeps it.
  */
-static void i2c_hid_find_max_report(struct hid_device *hid, unsigned int type,
-		unsigned int *max)
+static ssize_t i2c_hid_rdesc_read(struct file *file, char __user *ubuf,
+		size_t count, loff_t *ppos)
 {
-	struct hid_report *report;
-	unsigned int size;
+	struct i2c_hid *ihid = file->private_data;
+	struct i2c_hid_rdesc_entry *entry;
+	ssize_t ret = -ENODATA;
 
-	/* We should not rely on wMaxInputLength, as some devices may set it to
-	 * a wrong length. */
-	list_for_each_entry(report, &hid->report_enum[type].report_list, list) {
-		size = i2c_hid_get_report_length(report);
-		if (*max < size)
-			*max = size;
+	mutex_lock(&i2c_hid_rdesc_lock);
+	entry = i2c_hid_rdesc_find(&ihid->hdesc);
+	if (entry && entry->data)
+		ret = simple_read_from_buffer(ubuf, count, ppos, entry->data,
+				le16_to_cpu(ihid->hdesc.wReportDescLength));
+	mutex_unlock(&i2c_hid_rdesc_lock);
+
+	return ret;
+}
+
+static const struct file_operations i2c_hid_rdesc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.read		= i2c_hid_rdesc_read,
+	.llseek		= default_llseek,
+};
+
+static int i2c_hid_debug_log_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid *ihid = m->private;
+	struct i2c_hid_dbg_log *log = ihid->dbg_log;
+	struct i2c_hid_dbg_rec *recs, *rec;
+	unsigned long head, n;
+
+	recs = kmalloc(sizeof(log->recs), GFP_KERNEL);
+	if (!recs)
+		return -ENOMEM;
+
+	spin_lock(&log->lock);
+	memcpy(recs, log->recs, sizeof(log->recs));
+	head = log->head;
+	spin_unlock(&log->lock);
+
+	n = head > I2C_HID_DBG_LOG_RECORDS ? head - I2C_HID_DBG_LOG_RECORDS : 0;
+	for (; n != head; n++) {
+		rec = &recs[n & (I2C_HID_DBG_LOG_RECORDS - 1)];
+		seq_printf(m, "%llu %s%*ph%s\n", rec->timestamp_ns,
+			   i2c_hid_dbg_names[rec->type],
+			   min_t(int, rec->len, sizeof(rec->data)), rec->data,
+			   rec->len > sizeof(rec->data) ? " ..." : "");
 	}
+
+	kfree(recs);
+	return 0;
 }
 
-static void i2c_hid_free_buffers(struct i2c_hid *ihid)
+static int i2c_hid_debug_log_open(struct inode *inode, struct file *file)
 {
-	kfree(ihid->inbuf);
-	kfree(ihid->rawbuf);
-	kfree(ihid->argsbuf);
-	kfree(ihid->cmdbuf);
-	ihid->inbuf = NULL;
-	ihid->rawbuf = NULL;
-	ihid->cmdbuf = NULL;
-	ihid->argsbuf = NULL;
-	ihid->bufsize = 0;
+	return single_open(file, i2c_hid_debug_log_show, inode->i_private);
 }
 
-static int i2c_hid_alloc_buffers(struct i2c_hid *ihid, size_t report_size)
+static const struct file_operations i2c_hid_debug_log_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_debug_log_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Self-check of the IRQ thread scheduling: its settings and percentiles of
+ * the "sched" latency stage, the delay from the hard IRQ until the thread
+ * runs. Reset the latency histograms, use the device, then read this.
+ */
+static int i2c_hid_sched_check_show(struct seq_file *m, void *unused)
 {
-	/* the worst case is computed from the set_report command with a
-	 * reportID > 15 and the maximum report length */
-	int args_len = sizeof(__u8) + /* optional ReportID byte */
-		       sizeof(__u16) + /* data register */
-		       sizeof(__u16) + /* size of the report */
-		       report_size; /* report */
+	static const unsigned int permille[] = { 500, 900, 990, 999 };
+	static const char * const names[] = { "p50", "p90", "p99", "p99.9" };
+	struct i2c_hid *ihid = m->private;
+	u64 count[I2C_HID_LAT_BUCKETS] = { 0 };
+	u64 total = 0, seen = 0;
+	int bucket, cpu, i = 0, max = 0, p99 = 0;
+	pid_t pid = READ_ONCE(ihid->irq_pid);
+
+	if (pid)
+		seq_printf(m, "irq thread pid %d\n", pid);
+	else
+		seq_puts(m, "irq thread has not run yet\n");
+	seq_printf(m, "policy %s priority %d cpus %*pbl%s\n",
+		   i2c_hid_sched_policy_name(ihid->sched_policy),
+		   ihid->sched_prio, cpumask_pr_args(ihid->irq_cpus),
+		   READ_ONCE(ihid->sched_gen) != ihid->sched_applied ?
+		   " (pending)" : "");
+
+	for_each_possible_cpu(cpu) {
+		u64 *sched = per_cpu_ptr(ihid->lat, cpu)->buckets[I2C_HID_LAT_SCHED];
+
+		for (bucket = 0; bucket < I2C_HID_LAT_BUCKETS; bucket++)
+			count[bucket] += sched[bucket];
+	}
 
-	ihid->inbuf = kzalloc(report_size, GFP_KERNEL);
-	ihid->rawbuf = kzalloc(report_size, GFP_KERNEL);
-	ihid->argsbuf = kzalloc(args_len, GFP_KERNEL);
-	ihid->cmdbuf = kzalloc(sizeof(union command) + args_len, GFP_KERNEL);
+	for (bucket = 0; bucket < I2C_HID_LAT_BUCKETS; bucket++) {
+		total += count[bucket];
+		if (count[bucket])
+			max = bucket;
+	}
 
-	if (!ihid->inbuf || !ihid->rawbuf || !ihid->argsbuf || !ihid->cmdbuf) {
-		i2c_hid_free_buffers(ihid);
-		return -ENOMEM;
+	if (!total) {
+		seq_puts(m, "no scheduling delay samples, is latency_stats on?\n");
+		return 0;
 	}
 
-	ihid->bufsize = report_size;
+	seq_printf(m, "samples %llu\n", total);
+	for (bucket = 0; bucket < I2C_HID_LAT_BUCKETS &&
+			 i < ARRAY_SIZE(permille); bucket++) {
+		seen += count[bucket];
+		for (; i < ARRAY_SIZE(permille) &&
+		       seen * 1000 >= total * permille[i]; i++) {
+			seq_printf(m, "%-6s < %llu ns\n", names[i],
+				   2ULL << bucket);
+			if (permille[i] == 990)
+				p99 = bucket;
+		}
+	}
+	seq_printf(m, "%-6s < %llu ns\n", "max", 2ULL << max);
+
+	if ((1ULL << p99) >= I2C_HID_SCHED_DELAY_WARN_NS)
+		seq_puts(m, "p99 scheduling delay above 1ms: raise the priority or move the IRQ to a less busy CPU\n");
 
 	return 0;
 }
 
-static int i2c_hid_get_raw_report(struct hid_device *hid,
-		unsigned char report_number, __u8 *buf, size_t count,
-		unsigned char report_type)
+static int i2c_hid_sched_check_open(struct inode *inode, struct file *file)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	size_t ret_count, ask_count;
-	int ret;
+	return single_open(file, i2c_hid_sched_check_show, inode->i_private);
+}
 
-	if (report_type == HID_OUTPUT_REPORT)
-		return -EINVAL;
+static const struct file_operations i2c_hid_sched_check_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_sched_check_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	/* +2 bytes to include the size of the reply in the query buffer */
-	ask_count = min(count + 2, (size_t)ihid->bufsize);
+static int i2c_hid_boot_times_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid *ihid = m->private;
+	int phase;
 
-	ret = i2c_hid_get_report(client,
-			report_type == HID_FEATURE_REPORT ? 0x03 : 0x01,
-			report_number, ihid->rawbuf, ask_count);
+	seq_printf(m, "%-14s %s\n", "#phase", "us");
+	for (phase = 0; phase < I2C_HID_BOOT_PHASES; phase++)
+		seq_printf(m, "%-14s %llu\n", i2c_hid_boot_names[phase],
+			   div_u64(ihid->boot_ns[phase], NSEC_PER_USEC));
+	seq_printf(m, "%-14s %d\n", "reset_tries", ihid->boot_resets);
 
-	if (ret < 0)
-		return ret;
+	return 0;
+}
 
-	ret_count = ihid->rawbuf[0] | (ihid->rawbuf[1] << 8);
+static int i2c_hid_boot_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, i2c_hid_boot_times_show, inode->i_private);
+}
 
-	if (ret_count <= 2)
-		return 0;
+static const struct file_operations i2c_hid_boot_times_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_boot_times_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	ret_count = min(ret_count, ask_count);
+/* the last system suspend, how long it took and what it sent */
+static int i2c_hid_suspend_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid *ihid = m->private;
 
-	/* The query buffer contains the size, dropping it in the reply */
-	count = min(count, ret_count - 2);
-	memcpy(buf, ihid->rawbuf + 2, count);
+	seq_printf(m, "blocked_us %llu\n",
+		   div_u64(ihid->suspend_ns, NSEC_PER_USEC));
+	seq_printf(m, "runtime_suspended %d\n", ihid->suspend_rpm);
+	seq_printf(m, "woken %d\n", ihid->suspend_woken);
+	seq_printf(m, "power_cmds %llu\n", ihid->suspend_power_cmds);
 
-	return count;
+	return 0;
 }
 
-static int i2c_hid_output_raw_report(struct hid_device *hid, __u8 *buf,
-		size_t count, unsigned char report_type, bool use_data)
+static int i2c_hid_suspend_open(struct inode *inode, struct file *file)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	int report_id = buf[0];
-	int ret;
-
-	if (report_type == HID_INPUT_REPORT)
-		return -EINVAL;
-
-	mutex_lock(&ihid->reset_lock);
+	return single_open(file, i2c_hid_suspend_show, inode->i_private);
+}
 
-	if (report_id) {
-		buf++;
-		count--;
-	}
+static const struct file_operations i2c_hid_suspend_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_suspend_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	ret = i2c_hid_set_or_send_report(client,
-				report_type == HID_FEATURE_REPORT ? 0x03 : 0x02,
-				report_id, buf, count, use_data);
+/* the last system resume, how long it blocked and until input flowed */
+static int i2c_hid_resume_show(struct seq_file *m, void *unused)
+{
+	struct i2c_hid *ihid = m->private;
 
-	if (report_id && ret >= 0)
-		ret++; /* add report_id to the number of transfered bytes */
+	seq_printf(m, "mode %s\n", ihid->resume_async ? "async" : "sync");
+	seq_printf(m, "blocked_us %llu\n",
+		   div_u64(ihid->resume_blocked_ns, NSEC_PER_USEC));
+	seq_printf(m, "ready_us %llu\n",
+		   div_u64(ihid->resume_ready_ns, NSEC_PER_USEC));
+	seq_printf(m, "pending %d\n",
+		   test_bit(I2C_HID_RESUMING, &ihid->flags));
+	seq_printf(m, "result %d\n", ihid->resume_ret);
 
-	mutex_unlock(&ihid->reset_lock);
+	return 0;
+}
 
-	return ret;
+static int i2c_hid_resume_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, i2c_hid_resume_show, inode->i_private);
 }
 
-static int i2c_hid_output_report(struct hid_device *hid, __u8 *buf,
-		size_t count)
+static const struct file_operations i2c_hid_resume_fops = {
+	.owner		= THIS_MODULE,
+	.open		= i2c_hid_resume_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void i2c_hid_debugfs_init(struct i2c_hid *ihid)
 {
-	return i2c_hid_output_raw_report(hid, buf, count, HID_OUTPUT_REPORT,
-			false);
+	ihid->debugfs = debugfs_create_dir(dev_name(&ihid->client->dev),
+					   i2c_hid_debugfs_root);
+	if (IS_ERR_OR_NULL(ihid->debugfs))
+		return;
+
+	debugfs_create_file("latency", 0444, ihid->debugfs, ihid,
+			    &i2c_hid_latency_fops);
+	debugfs_create_file("latency_reset", 0200, ihid->debugfs, ihid,
+			    &i2c_hid_latency_reset_fops);
+	debugfs_create_file("debug_log", 0400, ihid->debugfs, ihid,
+			    &i2c_hid_debug_log_fops);
+
+	if (!ihid->polled)
+		debugfs_create_file("sched_check", 0444, ihid->debugfs, ihid,
+				    &i2c_hid_sched_check_fops);
+	debugfs_create_file("boot_times", 0444, ihid->debugfs, ihid,
+			    &i2c_hid_boot_times_fops);
+	debugfs_create_file("suspend", 0444, ihid->debugfs, ihid,
+			    &i2c_hid_suspend_fops);
+	debugfs_create_file("resume", 0444, ihid->debugfs, ihid,
+			    &i2c_hid_resume_fops);
+	debugfs_create_file("report_descriptor", 0400, ihid->debugfs, ihid,
+			    &i2c_hid_rdesc_fops);
+
+	if (ihid->rec)
+		debugfs_create_file_size("recorder", 0400, ihid->debugfs, ihid,
+					 &i2c_hid_recorder_fops,
+					 ihid->rec->size);
 }
 
-static int i2c_hid_raw_request(struct hid_device *hid, unsigned char reportnum,
-			       __u8 *buf, size_t len, unsigned char rtype,
-			       int reqtype)
+static void i2c_hid_debugfs_exit(struct i2c_hid *ihid)
 {
-	switch (reqtype) {
-	case HID_REQ_GET_REPORT:
-		return i2c_hid_get_raw_report(hid, reportnum, buf, len, rtype);
-	case HID_REQ_SET_REPORT:
-		if (buf[0] != reportnum)
-			return -EINVAL;
-		return i2c_hid_output_raw_report(hid, buf, len, rtype, true);
-	default:
-		return -EIO;
-	}
+	debugfs_remove_recursive(ihid->debugfs);
+	ihid->debugfs = NULL;
 }
 
-static int i2c_hid_parse(struct hid_device *hid)
+/*
+ * The counters only ever increase, monitoring derives frame rates and bus
+ * utilization (xfer_ns over wall time) from the difference of two reads.
+ */
+static u64 i2c_hid_stat_sum(struct i2c_hid *ihid, size_t offset)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	struct i2c_hid_desc *hdesc = &ihid->hdesc;
-	unsigned int rsize;
-	char *rdesc;
-	int ret;
-	int tries = 3;
+	u64 sum = 0;
+	int cpu;
 
-	i2c_hid_dbg(ihid, "entering %s\n", __func__);
+	for_each_possible_cpu(cpu)
+		sum += *(u64 *)((u8 *)per_cpu_ptr(ihid->stats, cpu) + offset);
 
-	rsize = le16_to_cpu(hdesc->wReportDescLength);
-	if (!rsize || rsize > HID_MAX_DESCRIPTOR_SIZE) {
-		dbg_hid("weird size of report descriptor (%u)\n", rsize);
-		return -EINVAL;
-	}
+	return sum;
+}
 
-	do {
-		ret = i2c_hid_hwreset(client);
-		if (ret)
-			msleep(1000);
-	} while (tries-- > 0 && ret);
+#define I2C_HID_STAT_ATTR(_field)					\
+static ssize_t i2c_hid_show_##_field(struct device *dev,		\
+		struct device_attribute *attr, char *buf)		\
+{									\
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));	\
+									\
+	return sprintf(buf, "%llu\n", i2c_hid_stat_sum(ihid,		\
+			offsetof(struct i2c_hid_stats, _field)));	\
+}									\
+static struct device_attribute dev_attr_stat_##_field =		\
+	__ATTR(_field, 0444, i2c_hid_show_##_field, NULL)
+
+I2C_HID_STAT_ATTR(frames);
+I2C_HID_STAT_ATTR(short_reads);
+I2C_HID_STAT_ATTR(incomplete);
+I2C_HID_STAT_ATTR(dropped);
+I2C_HID_STAT_ATTR(bus_errors);
+I2C_HID_STAT_ATTR(resets);
+I2C_HID_STAT_ATTR(irq_ignored);
+I2C_HID_STAT_ATTR(irq_wakeups);
+I2C_HID_STAT_ATTR(drained);
+I2C_HID_STAT_ATTR(drain_empty);
+I2C_HID_STAT_ATTR(empty_reads);
+I2C_HID_STAT_ATTR(poll_enter);
+I2C_HID_STAT_ATTR(poll_exit);
+I2C_HID_STAT_ATTR(polls);
+I2C_HID_STAT_ATTR(polls_empty);
+I2C_HID_STAT_ATTR(bytes_read);
+I2C_HID_STAT_ATTR(bytes_written);
+I2C_HID_STAT_ATTR(xfer_ns);
+I2C_HID_STAT_ATTR(xfers);
+I2C_HID_STAT_ATTR(dma_xfers);
+I2C_HID_STAT_ATTR(pipe_overflow);
+I2C_HID_STAT_ATTR(runtime_suspends);
+I2C_HID_STAT_ATTR(runtime_resumes);
+I2C_HID_STAT_ATTR(power_cmds);
+I2C_HID_STAT_ATTR(power_skipped);
+I2C_HID_STAT_ATTR(rdesc_hits);
+I2C_HID_STAT_ATTR(rdesc_misses);
+I2C_HID_STAT_ATTR(rdesc_stale);
+I2C_HID_STAT_ATTR(feature_hits);
+I2C_HID_STAT_ATTR(feature_misses);
+I2C_HID_STAT_ATTR(req_waits);
+I2C_HID_STAT_ATTR(cmd_queued);
+
+static struct attribute *i2c_hid_stats_attrs[] = {
+	&dev_attr_stat_frames.attr,
+	&dev_attr_stat_short_reads.attr,
+	&dev_attr_stat_incomplete.attr,
+	&dev_attr_stat_dropped.attr,
+	&dev_attr_stat_bus_errors.attr,
+	&dev_attr_stat_resets.attr,
+	&dev_attr_stat_irq_ignored.attr,
+	&dev_attr_stat_irq_wakeups.attr,
+	&dev_attr_stat_drained.attr,
+	&dev_attr_stat_drain_empty.attr,
+	&dev_attr_stat_empty_reads.attr,
+	&dev_attr_stat_poll_enter.attr,
+	&dev_attr_stat_poll_exit.attr,
+	&dev_attr_stat_polls.attr,
+	&dev_attr_stat_polls_empty.attr,
+	&dev_attr_stat_bytes_read.attr,
+	&dev_attr_stat_bytes_written.attr,
+	&dev_attr_stat_xfer_ns.attr,
+	&dev_attr_stat_xfers.attr,
+	&dev_attr_stat_dma_xfers.attr,
+	&dev_attr_stat_pipe_overflow.attr,
+	&dev_attr_stat_runtime_suspends.attr,
+	&dev_attr_stat_runtime_resumes.attr,
+	&dev_attr_stat_power_cmds.attr,
+	&dev_attr_stat_power_skipped.attr,
+	&dev_attr_stat_rdesc_hits.attr,
+	&dev_attr_stat_rdesc_misses.attr,
+	&dev_attr_stat_rdesc_stale.attr,
+	&dev_attr_stat_feature_hits.attr,
+	&dev_attr_stat_feature_misses.attr,
+	&dev_attr_stat_req_waits.attr,
+	&dev_attr_stat_cmd_queued.attr,
+	NULL
+};
 
-	if (ret)
-		return ret;
+static const struct attribute_group i2c_hid_stats_group = {
+	.name	= "i2c_hid_stats",
+	.attrs	= i2c_hid_stats_attrs,
+};
 
-	rdesc = kzalloc(rsize, GFP_KERNEL);
+static int i2c_hid_add_device(struct i2c_hid *ihid)
+{
+	ktime_t start = ktime_get();
+	int ret;
 
-	if (!rdesc) {
-		dbg_hid("couldn't allocate rdesc memory\n");
-		return -ENOMEM;
-	}
+	ret = hid_add_device(ihid->hid);
+	i2c_hid_boot_record(ihid, I2C_HID_BOOT_ADD, start);
+	if (!ret)
+		i2c_hid_boot_record(ihid, I2C_HID_BOOT_READY, ihid->boot_start);
 
-	i2c_hid_dbg(ihid, "asking HID report descriptor\n");
+	return ret;
+}
 
-	ret = i2c_hid_command(client, &hid_report_descr_cmd, rdesc, rsize);
-	if (ret) {
-		hid_err(hid, "reading report descriptor failed\n");
-		kfree(rdesc);
-		return -EIO;
-	}
+/*
+ * With deferred_add the device stays bound when this fails, there is just
+ * no HID device behind it until it is rebound.
+ */
+static void i2c_hid_add_work(struct work_struct *work)
+{
+	struct i2c_hid *ihid = container_of(work, struct i2c_hid, add_work);
+	int ret;
 
-	i2c_hid_dbg(ihid, "Report Descriptor: %*ph\n", rsize, rdesc);
+	ret = i2c_hid_add_device(ihid);
+	if (ret && ret != -ENODEV)
+		hid_err(ihid->client, "can't add hid device: %d\n", ret);
 
-	ret = hid_parse_report(hid, rdesc, rsize);
-	kfree(rdesc);
-	if (ret) {
-		dbg_hid("parsing report descriptor failed\n");
+	i2c_hid_pm_put(ihid->client);
+}
+
+/* the reset after a system resume, run by resume_work with async_resume */
+static int i2c_hid_resume_reset(struct i2c_hid *ihid)
+{
+	struct hid_device *hid = ihid->hid;
+	int ret;
+
+	ret = i2c_hid_hwreset(ihid->client);
+	if (ret)
 		return ret;
-	}
+
+	if (hid->driver && hid->driver->reset_resume)
+		return hid->driver->reset_resume(hid);
 
 	return 0;
 }
 
-static int i2c_hid_start(struct hid_device *hid)
+static void i2c_hid_resume_done(struct i2c_hid *ihid, int ret)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	int ret;
-	unsigned int bufsize = HID_MIN_BUFFER_SIZE;
-
-	i2c_hid_find_max_report(hid, HID_INPUT_REPORT, &bufsize);
-	i2c_hid_find_max_report(hid, HID_OUTPUT_REPORT, &bufsize);
-	i2c_hid_find_max_report(hid, HID_FEATURE_REPORT, &bufsize);
+	ihid->resume_ready_ns = ktime_to_ns(ktime_sub(ktime_get(),
+						      ihid->resume_start));
+	ihid->resume_ret = ret;
+	clear_bit(I2C_HID_RESUMING, &ihid->flags);
+}
 
-	if (bufsize > ihid->bufsize) {
-		i2c_hid_free_buffers(ihid);
+static void i2c_hid_resume_work(struct work_struct *work)
+{
+	struct i2c_hid *ihid = container_of(work, struct i2c_hid,
+					    resume_work);
+	int ret;
 
-		ret = i2c_hid_alloc_buffers(ihid, bufsize);
+	ret = i2c_hid_resume_reset(ihid);
+	if (ret)
+		dev_err(&ihid->client->dev,
+			"failed to reset the device after resume: %d\n", ret);
 
-		if (ret)
-			return ret;
-	}
+	i2c_hid_resume_done(ihid, ret);
+	i2c_hid_pm_put(ihid->client);
+}
 
-	if (!(hid->quirks & HID_QUIRK_NO_INIT_REPORTS))
-		i2c_hid_init_reports(hid);
+static bool i2c_hid_sched_prio_valid(int policy, int prio)
+{
+	if (policy == SCHED_NORMAL)
+		return prio >= MIN_NICE && prio <= MAX_NICE;
 
-	return 0;
+	return prio > 0 && prio < MAX_RT_PRIO;
 }
 
-static void i2c_hid_stop(struct hid_device *hid)
+static ssize_t policy_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
-	hid->claimed = 0;
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+
+	return sprintf(buf, "%s\n",
+		       i2c_hid_sched_policy_name(ihid->sched_policy));
 }
 
-static int i2c_hid_open(struct hid_device *hid)
+static ssize_t policy_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	int ret = 0;
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+	int i, policy;
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
-	mutex_lock(&i2c_hid_open_mut);
-	if (!hid->open++) {
-		ret = pm_runtime_get_sync(&client->dev);
-		if (ret < 0) {
-			hid->open--;
-			goto done;
-		}
-		set_bit(I2C_HID_STARTED, &ihid->flags);
-	}
-done:
-	mutex_unlock(&i2c_hid_open_mut);
-	return ret < 0 ? ret : 0;
-#else
-	ret = pm_runtime_get_sync(&client->dev);
-	if (ret < 0)
-		return ret;
+	for (i = 0; i < ARRAY_SIZE(i2c_hid_sched_policies); i++)
+		if (sysfs_streq(buf, i2c_hid_sched_policies[i].name))
+			break;
+	if (i == ARRAY_SIZE(i2c_hid_sched_policies))
+		return -EINVAL;
+
+	policy = i2c_hid_sched_policies[i].policy;
+
+	mutex_lock(&ihid->sched_lock);
+	/* an RT priority makes no sense as nice value and vice versa */
+	if (!i2c_hid_sched_prio_valid(policy, ihid->sched_prio))
+		ihid->sched_prio = policy == SCHED_NORMAL ?
+				   0 : I2C_HID_IRQ_PRIO_DEFAULT;
+	ihid->sched_policy = policy;
+	WRITE_ONCE(ihid->sched_gen, ihid->sched_gen + 1);
+	mutex_unlock(&ihid->sched_lock);
+
+	return count;
+}
 
-	set_bit(I2C_HID_STARTED, &ihid->flags);
-	return 0;
-#endif
+static ssize_t priority_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
 
+	return sprintf(buf, "%d\n", ihid->sched_prio);
 }
 
-static void i2c_hid_close(struct hid_device *hid)
+static ssize_t priority_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+	int prio, ret;
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
-	/* protecting hid->open to make sure we don't restart
-	 * data acquistion due to a resumption we no longer
-	 * care about
-	 */
-	mutex_lock(&i2c_hid_open_mut);
-	if (!--hid->open) {
-		clear_bit(I2C_HID_STARTED, &ihid->flags);
+	ret = kstrtoint(buf, 0, &prio);
+	if (ret)
+		return ret;
 
-		/* Save some power */
-		pm_runtime_put(&client->dev);
+	mutex_lock(&ihid->sched_lock);
+	if (i2c_hid_sched_prio_valid(ihid->sched_policy, prio)) {
+		ihid->sched_prio = prio;
+		WRITE_ONCE(ihid->sched_gen, ihid->sched_gen + 1);
+	} else {
+		ret = -EINVAL;
 	}
-	mutex_unlock(&i2c_hid_open_mut);
-#else
-	clear_bit(I2C_HID_STARTED, &ihid->flags);
+	mutex_unlock(&ihid->sched_lock);
 
-	/* Save some power */
-	pm_runtime_put(&client->dev);
-#endif
+	return ret ? ret : count;
 }
 
-static int i2c_hid_power(struct hid_device *hid, int lvl)
+static ssize_t cpus_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
-	struct i2c_client *client = hid->driver_data;
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-
-	i2c_hid_dbg(ihid, "%s lvl:%d\n", __func__, lvl);
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
 
-	switch (lvl) {
-	case PM_HINT_FULLON:
-		pm_runtime_get_sync(&client->dev);
-		break;
-	case PM_HINT_NORMAL:
-		pm_runtime_put(&client->dev);
-		break;
-	}
-	return 0;
+	return sprintf(buf, "%*pbl\n", cpumask_pr_args(ihid->irq_cpus));
 }
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
-static struct hid_ll_driver i2c_hid_ll_driver = {
-#else
-struct hid_ll_driver i2c_hid_ll_driver = {
-#endif
-	.parse = i2c_hid_parse,
-	.start = i2c_hid_start,
-	.stop = i2c_hid_stop,
-	.open = i2c_hid_open,
-	.close = i2c_hid_close,
-	.power = i2c_hid_power,
-	.output_report = i2c_hid_output_report,
-	.raw_request = i2c_hid_raw_request,
-};
-
-static int i2c_hid_init_irq(struct i2c_client *client)
+static ssize_t cpus_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
-	struct i2c_hid *ihid = i2c_get_clientdata(client);
-	unsigned long irqflags = 0;
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+	cpumask_var_t cpus;
 	int ret;
 
-	dev_dbg(&client->dev, "Requesting IRQ: %d\n", client->irq);
-
-	if (!irq_get_trigger_type(client->irq))
-		irqflags = IRQF_TRIGGER_LOW;
-
-	ret = request_threaded_irq(client->irq, NULL, i2c_hid_irq,
-				   irqflags | IRQF_ONESHOT, client->name, ihid);
-	if (ret < 0) {
-		dev_warn(&client->dev,
-			"Could not register for %s interrupt, irq = %d,"
-			" ret = %d\n",
-			client->name, client->irq, ret);
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
 
-		return ret;
+	ret = cpulist_parse(buf, cpus);
+	if (!ret) {
+		mutex_lock(&ihid->sched_lock);
+		cpumask_copy(ihid->irq_cpus, cpus);
+		ret = i2c_hid_irq_affinity_apply(ihid);
+		mutex_unlock(&ihid->sched_lock);
 	}
 
-	return 0;
+	free_cpumask_var(cpus);
+	return ret ? ret : count;
 }
 
-static int i2c_hid_fetch_hid_descriptor(struct i2c_hid *ihid)
+static DEVICE_ATTR_RW(policy);
+static DEVICE_ATTR_RW(priority);
+static DEVICE_ATTR_RW(cpus);
+
+static struct attribute *i2c_hid_irq_sched_attrs[] = {
+	&dev_attr_policy.attr,
+	&dev_attr_priority.attr,
+	&dev_attr_cpus.attr,
+	NULL
+};
+
+/* polled devices have no IRQ thread to tune */
+static umode_t i2c_hid_irq_sched_visible(struct kobject *kobj,
+		struct attribute *attr, int n)
 {
-	struct i2c_client *client = ihid->client;
-	struct i2c_hid_desc *hdesc = &ihid->hdesc;
-	unsigned int dsize;
-	int ret;
+	struct device *dev = kobj_to_dev(kobj);
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
 
-	/* i2c hid fetch using a fixed descriptor size (30 bytes) */
-	i2c_hid_dbg(ihid, "Fetching the HID descriptor\n");
-	ret = i2c_hid_command(client, &hid_descr_cmd, ihid->hdesc_buffer,
-				sizeof(struct i2c_hid_desc));
-	if (ret) {
-		dev_err(&client->dev, "hid_descr_cmd failed\n");
-		return -ENODEV;
-	}
+	return ihid->polled ? 0 : attr->mode;
+}
 
-	/* Validate the length of HID descriptor, the 4 first bytes:
-	 * bytes 0-1 -> length
-	 * bytes 2-3 -> bcdVersion (has to be 1.00) */
-	/* check bcdVersion == 1.0 */
-	if (le16_to_cpu(hdesc->bcdVersion) != 0x0100) {
-		dev_err(&client->dev,
-			"unexpected HID descriptor bcdVersion (0x%04hx)\n",
-			le16_to_cpu(hdesc->bcdVersion));
-		return -ENODEV;
-	}
+static const struct attribute_group i2c_hid_irq_sched_group = {
+	.name		= "irq_sched",
+	.attrs		= i2c_hid_irq_sched_attrs,
+	.is_visible	= i2c_hid_irq_sched_visible,
+};
 
-	/* Descriptor length should be 30 bytes as per the specification */
-	dsize = le16_to_cpu(hdesc->wHIDDescLength);
-	if (dsize != sizeof(struct i2c_hid_desc)) {
-		dev_err(&client->dev, "weird size of HID descriptor (%u)\n",
-			dsize);
-		return -ENODEV;
+/* lists the per report overrides, then the feature_cache_ms default */
+static ssize_t ttl_ms_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+	ssize_t len = 0;
+	int i, ttl;
+
+	for (i = 0; i < HID_MAX_IDS; i++) {
+		ttl = READ_ONCE(ihid->features[i].ttl_ms);
+		if (ttl >= 0)
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d\n",
+					 i, ttl);
 	}
-	i2c_hid_dbg(ihid, "HID Descriptor: %*ph\n", dsize, ihid->hdesc_buffer);
-	return 0;
+	len += scnprintf(buf + len, PAGE_SIZE - len, "default %u\n",
+			 READ_ONCE(feature_cache_ms));
+
+	return len;
 }
 
-#ifdef CONFIG_ACPI
-static int i2c_hid_acpi_pdata(struct i2c_client *client,
-		struct i2c_hid_platform_data *pdata)
+/* "<report id> <ms>", 0 never caches the report, -1 uses the default */
+static ssize_t ttl_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
-	static u8 i2c_hid_guid[] = {
-		0xF7, 0xF6, 0xDF, 0x3C, 0x67, 0x42, 0x55, 0x45,
-		0xAD, 0x05, 0xB3, 0x0A, 0x3D, 0x89, 0x38, 0xDE,
-	};
-#else
-	static guid_t i2c_hid_guid =
-		GUID_INIT(0x3CDFF6F7, 0x4267, 0x4555,
-			  0xAD, 0x05, 0xB3, 0x0A, 0x3D, 0x89, 0x38, 0xDE);
-#endif
-	union acpi_object *obj;
-	struct acpi_device *adev;
-	acpi_handle handle;
-
-	handle = ACPI_HANDLE(&client->dev);
-	if (!handle || acpi_bus_get_device(handle, &adev))
-		return -ENODEV;
+	struct i2c_hid *ihid = i2c_get_clientdata(to_i2c_client(dev));
+	unsigned int id;
+	int ttl;
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
-	obj = acpi_evaluate_dsm_typed(handle, i2c_hid_guid, 1, 1, NULL,
-				      ACPI_TYPE_INTEGER);
-#else
-	obj = acpi_evaluate_dsm_typed(handle, &i2c_hid_guid, 1, 1, NULL,
-				      ACPI_TYPE_INTEGER);
-#endif
-	if (!obj) {
-		dev_err(&client->dev, "device _DSM execution failed\n");
-		return -ENODEV;
-	}
+	if (sscanf(buf, "%u %d", &id, &ttl) != 2 || id >= HID_MAX_IDS ||
+	    ttl < -1)
+		return -EINVAL;
 
-	pdata->hid_descriptor_address = obj->integer.value;
-	ACPI_FREE(obj);
+	WRITE_ONCE(ihid->features[id].ttl_ms, ttl);
+	i2c_hid_feature_invalidate(ihid, id);
 
-	return 0;
+	return count;
 }
 
-static const struct acpi_device_id i2c_hid_acpi_match[] = {
-	{"ACPI0C50", 0 },
-	{"PNP0C50", 0 },
-	{ },
+static DEVICE_ATTR_RW(ttl_ms);
+
+static struct attribute *i2c_hid_feature_attrs[] = {
+	&dev_attr_ttl_ms.attr,
+	NULL
 };
-MODULE_DEVICE_TABLE(acpi, i2c_hid_acpi_match);
-#else
-static inline int i2c_hid_acpi_pdata(struct i2c_client *client,
-		struct i2c_hid_platform_data *pdata)
-{
-	return -ENODEV;
-}
-#endif
 
-#ifdef CONFIG_OF
-static int i2c_hid_of_probe(struct i2c_client *client,
-		struct i2c_hid_platform_data *pdata)
+static const struct attribute_group i2c_hid_feature_group = {
+	.name	= "feature_cache",
+	.attrs	= i2c_hid_feature_attrs,
+};
+
+static struct i2c_hid_feature *i2c_hid_feature_alloc(void)
 {
-	struct device *dev = &client->dev;
-	u32 val;
-	int ret;
+	struct i2c_hid_feature *features;
+	int i;
 
-	ret = of_property_read_u32(dev->of_node, "hid-descr-addr", &val);
-	if (ret) {
-		dev_err(&client->dev, "HID register address not provided\n");
-		return -ENODEV;
-	}
-	if (val >> 16) {
-		dev_err(&client->dev, "Bad HID register address: 0x%08x\n",
-			val);
-		return -EINVAL;
-	}
-	pdata->hid_descriptor_address = val;
+	features = kcalloc(HID_MAX_IDS, sizeof(*features), GFP_KERNEL);
+	if (!features)
+		return NULL;
 
-	return 0;
+	for (i = 0; i < HID_MAX_IDS; i++)
+		features[i].ttl_ms = -1;
+
+	return features;
 }
 
-static const struct of_device_id i2c_hid_of_match[] = {
-	{ .compatible = "hid-over-i2c" },
-	{},
-};
-MODULE_DEVICE_TABLE(of, i2c_hid_of_match);
-#else
-static inline int i2c_hid_of_probe(struct i2c_client *client,
-		struct i2c_hid_platform_data *pdata)
+static void i2c_hid_feature_free(struct i2c_hid_feature *features)
 {
-	return -ENODEV;
+	int i;
+
+	if (!features)
+		return;
+
+	for (i = 0; i < HID_MAX_IDS; i++)
+		kfree(features[i].data);
+	kfree(features);
 }
-#endif
 
 static int i2c_hid_probe(struct i2c_client *client,
 			 const struct i2c_device_id *dev_id)
@@ -1059,19 +3607,22 @@ static int i2c_hid_probe(struct i2c_client *client,
 	__u16 hidRegister;
 	const struct i2c_hid_quirks *quirks;
 	struct i2c_hid_platform_data *platform_data = client->dev.platform_data;
+	ktime_t boot_start = ktime_get(), start;
 
 	dbg_hid("HID probe called for i2c 0x%02x\n", client->addr);
 
-	if (!client->irq) {
+	if (client->irq == -EPROBE_DEFER)
+		return client->irq;
+
+	if (!client->irq && !poll_hz) {
 		dev_err(&client->dev,
 			"HID over i2c has not been provided an Int IRQ\n");
 		return -EINVAL;
 	}
 
-	if (client->irq < 0) {
-		if (client->irq != -EPROBE_DEFER)
-			dev_err(&client->dev,
-				"HID over i2c doesn't have a valid IRQ\n");
+	if (client->irq < 0 && !poll_hz) {
+		dev_err(&client->dev,
+			"HID over i2c doesn't have a valid IRQ\n");
 		return client->irq;
 	}
 
@@ -1097,12 +3648,48 @@ static int i2c_hid_probe(struct i2c_client *client,
 	i2c_set_clientdata(client, ihid);
 
 	ihid->client = client;
+	ihid->boot_start = boot_start;
 
 	hidRegister = ihid->pdata.hid_descriptor_address;
 	ihid->wHIDDescRegister = cpu_to_le16(hidRegister);
 
 	init_waitqueue_head(&ihid->wait);
+	init_waitqueue_head(&ihid->req_wait);
+	init_waitqueue_head(&ihid->cmd_wait);
 	mutex_init(&ihid->reset_lock);
+	mutex_init(&ihid->input_lock);
+	mutex_init(&ihid->sched_lock);
+	mutex_init(&ihid->feature_lock);
+	ihid->power_state = I2C_HID_PWR_UNKNOWN;
+	ihid->sched_policy = SCHED_FIFO;
+	ihid->sched_prio = I2C_HID_IRQ_PRIO_DEFAULT;
+	hrtimer_init(&ihid->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ihid->poll_timer.function = i2c_hid_poll_timer;
+	INIT_WORK(&ihid->poll_work, i2c_hid_poll_work);
+	INIT_WORK(&ihid->pipe_work, i2c_hid_pipe_work);
+	INIT_WORK(&ihid->resume_work, i2c_hid_resume_work);
+	INIT_WORK(&ihid->add_work, i2c_hid_add_work);
+	INIT_DELAYED_WORK(&ihid->init_work, i2c_hid_init_work);
+
+	ihid->lat = alloc_percpu(struct i2c_hid_lat_hist);
+	ihid->stats = alloc_percpu(struct i2c_hid_stats);
+	ihid->dbg_log = kzalloc(sizeof(*ihid->dbg_log), GFP_KERNEL);
+	ihid->features = i2c_hid_feature_alloc();
+	if (!ihid->lat || !ihid->stats || !ihid->dbg_log || !ihid->features ||
+	    !zalloc_cpumask_var(&ihid->irq_cpus, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	spin_lock_init(&ihid->dbg_log->lock);
+
+	if (recorder_slots) {
+		ihid->rec = i2c_hid_rec_alloc(recorder_slots);
+		if (!ihid->rec) {
+			ret = -ENOMEM;
+			goto err;
+		}
+	}
 
 	/* we need to allocate the command buffer without knowing the maximum
 	 * size of the reports. Let's use HID_MIN_BUFFER_SIZE, then we do the
@@ -1113,16 +3700,29 @@ static int i2c_hid_probe(struct i2c_client *client,
 
 	pm_runtime_get_noresume(&client->dev);
 	pm_runtime_set_active(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev, autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(&client->dev);
 	pm_runtime_enable(&client->dev);
 	device_enable_async_suspend(&client->dev);
 
+	start = ktime_get();
 	ret = i2c_hid_fetch_hid_descriptor(ihid);
+	start = i2c_hid_boot_record(ihid, I2C_HID_BOOT_DESC, start);
 	if (ret < 0)
 		goto err_pm;
 
-	ret = i2c_hid_init_irq(client);
-	if (ret < 0)
-		goto err_pm;
+	ihid->polled = client->irq <= 0 || (force_poll && poll_hz);
+	if (ihid->polled) {
+		dev_info(&client->dev, "no usable IRQ, polling at %u Hz\n",
+			 poll_hz);
+		i2c_hid_poll_begin(ihid);
+	} else {
+		ret = i2c_hid_init_irq(client);
+		if (ret < 0)
+			goto err_pm;
+		i2c_hid_irq_sched_init(ihid);
+		i2c_hid_boot_record(ihid, I2C_HID_BOOT_IRQ, start);
+	}
 
 	hid = hid_allocate_device();
 	if (IS_ERR(hid)) {
@@ -1154,28 +3754,70 @@ static int i2c_hid_probe(struct i2c_client *client,
 		ihid->reset_usleep_high = quirks->reset_usleep_high;
 	}
 
-	ret = hid_add_device(hid);
+	i2c_hid_debugfs_init(ihid);
+
+	ret = sysfs_create_group(&client->dev.kobj, &i2c_hid_stats_group);
+	if (ret)
+		goto err_mem_free;
+
+	ret = sysfs_create_group(&client->dev.kobj, &i2c_hid_irq_sched_group);
+	if (ret)
+		goto err_stats;
+
+	ret = sysfs_create_group(&client->dev.kobj, &i2c_hid_feature_group);
+	if (ret)
+		goto err_sched;
+
+	/* the work item drops the runtime PM reference */
+	if (deferred_add) {
+		queue_work(system_unbound_wq, &ihid->add_work);
+		i2c_hid_boot_record(ihid, I2C_HID_BOOT_PROBE, boot_start);
+		return 0;
+	}
+
+	ret = i2c_hid_add_device(ihid);
 	if (ret) {
 		if (ret != -ENODEV)
 			hid_err(client, "can't add hid device: %d\n", ret);
-		goto err_mem_free;
+		goto err_feature;
 	}
 
-	pm_runtime_put(&client->dev);
+	i2c_hid_pm_put(client);
+	i2c_hid_boot_record(ihid, I2C_HID_BOOT_PROBE, boot_start);
 	return 0;
 
+err_feature:
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_feature_group);
+
+err_sched:
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_irq_sched_group);
+
+err_stats:
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_stats_group);
+
 err_mem_free:
+	i2c_hid_debugfs_exit(ihid);
 	hid_destroy_device(hid);
 
 err_irq:
-	free_irq(client->irq, ihid);
+	if (ihid->polled)
+		i2c_hid_poll_cancel(ihid);
+	else
+		i2c_hid_free_irq(ihid);
 
 err_pm:
 	pm_runtime_put_noidle(&client->dev);
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 
 err:
 	i2c_hid_free_buffers(ihid);
+	i2c_hid_rec_put(ihid->rec);
+	kfree(ihid->dbg_log);
+	i2c_hid_feature_free(ihid->features);
+	free_cpumask_var(ihid->irq_cpus);
+	free_percpu(ihid->stats);
+	free_percpu(ihid->lat);
 	kfree(ihid);
 	return ret;
 }
@@ -1185,19 +3827,38 @@ static int i2c_hid_remove(struct i2c_client *client)
 	struct i2c_hid *ihid = i2c_get_clientdata(client);
 	struct hid_device *hid;
 
+	if (cancel_work_sync(&ihid->add_work))
+		pm_runtime_put_noidle(&client->dev);
+	if (cancel_work_sync(&ihid->resume_work))
+		pm_runtime_put_noidle(&client->dev);
+
 	pm_runtime_get_sync(&client->dev);
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 	pm_runtime_set_suspended(&client->dev);
 	pm_runtime_put_noidle(&client->dev);
 
 	hid = ihid->hid;
 	hid_destroy_device(hid);
 
-	free_irq(client->irq, ihid);
+	i2c_hid_input_disable(ihid);
+	if (!ihid->polled)
+		i2c_hid_free_irq(ihid);
+
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_feature_group);
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_irq_sched_group);
+	sysfs_remove_group(&client->dev.kobj, &i2c_hid_stats_group);
+	i2c_hid_debugfs_exit(ihid);
 
 	if (ihid->bufsize)
 		i2c_hid_free_buffers(ihid);
 
+	i2c_hid_rec_put(ihid->rec);
+	kfree(ihid->dbg_log);
+	i2c_hid_feature_free(ihid->features);
+	free_cpumask_var(ihid->irq_cpus);
+	free_percpu(ihid->stats);
+	free_percpu(ihid->lat);
 	kfree(ihid);
 
 	return 0;
@@ -1207,8 +3868,15 @@ static void i2c_hid_shutdown(struct i2c_client *client)
 {
 	struct i2c_hid *ihid = i2c_get_clientdata(client);
 
+	if (cancel_work_sync(&ihid->add_work))
+		pm_runtime_put_noidle(&client->dev);
+	if (cancel_work_sync(&ihid->resume_work))
+		pm_runtime_put_noidle(&client->dev);
+
+	i2c_hid_input_disable(ihid);
 	i2c_hid_set_power(client, I2C_HID_PWR_SLEEP);
-	free_irq(client->irq, ihid);
+	if (!ihid->polled)
+		i2c_hid_free_irq(ihid);
 }
 
 #ifdef CONFIG_PM_SLEEP
@@ -1217,17 +3885,33 @@ static int i2c_hid_suspend(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct i2c_hid *ihid = i2c_get_clientdata(client);
 	struct hid_device *hid = ihid->hid;
+	ktime_t start = ktime_get();
+	u64 power_cmds;
 	int ret;
 	int wake_status;
 
+	/* a deferred_add bring-up or a reset from the last resume */
+	flush_work(&ihid->add_work);
+	flush_work(&ihid->resume_work);
+
+	power_cmds = i2c_hid_stat_sum(ihid,
+			offsetof(struct i2c_hid_stats, power_cmds));
+	ihid->suspend_rpm = pm_runtime_suspended(dev);
+	ihid->suspend_woken = false;
+
 	if (hid->driver && hid->driver->suspend) {
 		/*
 		 * Wake up the device so that IO issues in
-		 * HID driver's suspend code can succeed.
+		 * HID driver's suspend code can succeed. Drivers that
+		 * do no IO there can be told about the suspend while
+		 * the device keeps sleeping.
 		 */
-		ret = pm_runtime_resume(dev);
-		if (ret < 0)
-			return ret;
+		if (ihid->suspend_rpm && READ_ONCE(suspend_wake)) {
+			ret = pm_runtime_resume(dev);
+			if (ret < 0)
+				return ret;
+			ihid->suspend_woken = true;
+		}
 
 		ret = hid->driver->suspend(hid, PMSG_SUSPEND);
 		if (ret < 0)
@@ -1235,13 +3919,13 @@ static int i2c_hid_suspend(struct device *dev)
 	}
 
 	if (!pm_runtime_suspended(dev)) {
+		i2c_hid_input_disable(ihid);
+
 		/* Save some power */
 		i2c_hid_set_power(client, I2C_HID_PWR_SLEEP);
-
-		disable_irq(client->irq);
 	}
 
-	if (device_may_wakeup(&client->dev)) {
+	if (device_may_wakeup(&client->dev) && !ihid->polled) {
 		wake_status = enable_irq_wake(client->irq);
 		if (!wake_status)
 			ihid->irq_wake_enabled = true;
@@ -1250,6 +3934,10 @@ static int i2c_hid_suspend(struct device *dev)
 				wake_status);
 	}
 
+	ihid->suspend_power_cmds = i2c_hid_stat_sum(ihid,
+			offsetof(struct i2c_hid_stats, power_cmds)) - power_cmds;
+	ihid->suspend_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
 	return 0;
 }
 
@@ -1261,6 +3949,16 @@ static int i2c_hid_resume(struct device *dev)
 	struct hid_device *hid = ihid->hid;
 	int wake_status;
 
+	ihid->resume_start = ktime_get();
+	ihid->resume_async = READ_ONCE(async_resume);
+
+	/* the device may have lost power while the system slept */
+	ihid->power_state = I2C_HID_PWR_UNKNOWN;
+
+	/* hold back input until the work item has reset the device */
+	if (ihid->resume_async)
+		set_bit(I2C_HID_RESUMING, &ihid->flags);
+
 	if (device_may_wakeup(&client->dev) && ihid->irq_wake_enabled) {
 		wake_status = disable_irq_wake(client->irq);
 		if (!wake_status)
@@ -1275,17 +3973,26 @@ static int i2c_hid_resume(struct device *dev)
 	pm_runtime_set_active(dev);
 	pm_runtime_enable(dev);
 
-	enable_irq(client->irq);
-	ret = i2c_hid_hwreset(client);
+	i2c_hid_input_enable(ihid);
+
+	/* CPU hotplug during suspend may have broken the affinity */
+	ret = i2c_hid_irq_affinity_apply(ihid);
 	if (ret)
-		return ret;
+		dev_warn(dev, "failed to restore the IRQ affinity: %d\n", ret);
 
-	if (hid->driver && hid->driver->reset_resume) {
-		ret = hid->driver->reset_resume(hid);
-		return ret;
+	if (ihid->resume_async) {
+		/* keep runtime PM off the device until the reset is done */
+		pm_runtime_get_noresume(dev);
+		queue_work(system_unbound_wq, &ihid->resume_work);
+		ret = 0;
+	} else {
+		ret = i2c_hid_resume_reset(ihid);
+		i2c_hid_resume_done(ihid, ret);
 	}
 
-	return 0;
+	ihid->resume_blocked_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							ihid->resume_start));
+	return ret;
 }
 #endif
 
@@ -1294,8 +4001,11 @@ static int i2c_hid_runtime_suspend(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 
+	trace_i2c_hid_runtime_suspend(client);
+	i2c_hid_stat_inc(i2c_get_clientdata(client), runtime_suspends);
+
+	i2c_hid_input_disable(i2c_get_clientdata(client));
 	i2c_hid_set_power(client, I2C_HID_PWR_SLEEP);
-	disable_irq(client->irq);
 	return 0;
 }
 
@@ -1303,7 +4013,11 @@ static int i2c_hid_runtime_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 
-	enable_irq(client->irq);
+	trace_i2c_hid_runtime_resume(client);
+	i2c_hid_stat_inc(i2c_get_clientdata(client), runtime_resumes);
+	i2c_hid_feature_invalidate(i2c_get_clientdata(client), -1);
+
+	i2c_hid_input_enable(i2c_get_clientdata(client));
 	i2c_hid_set_power(client, I2C_HID_PWR_ON);
 	return 0;
 }
@@ -1329,6 +4043,9 @@ static struct i2c_driver i2c_hid_driver = {
 		.pm	= &i2c_hid_pm,
 		.acpi_match_table = ACPI_PTR(i2c_hid_acpi_match),
 		.of_match_table = of_match_ptr(i2c_hid_of_match),
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 	},
 
 	.probe		= i2c_hid_probe,
@@ -1337,7 +4054,28 @@ static struct i2c_driver i2c_hid_driver = {
 	.id_table	= i2c_hid_id_table,
 };
 
-module_i2c_driver(i2c_hid_driver);
+static int __init i2c_hid_init(void)
+{
+	int ret;
+
+	i2c_hid_debugfs_root = debugfs_create_dir("i2c_hid", NULL);
+
+	ret = i2c_add_driver(&i2c_hid_driver);
+	if (ret)
+		debugfs_remove_recursive(i2c_hid_debugfs_root);
+
+	return ret;
+}
+
+static void __exit i2c_hid_exit(void)
+{
+	i2c_del_driver(&i2c_hid_driver);
+	debugfs_remove_recursive(i2c_hid_debugfs_root);
+	i2c_hid_rdesc_free_all();
+}
+
+module_init(i2c_hid_init);
+module_exit(i2c_hid_exit);
 
 MODULE_DESCRIPTION("HID over I2C core driver");
 MODULE_AUTHOR("Benjamin Tissoires <benjamin.tissoires@gmail.com>");
@@ -0,0 +1,324 @@
+/*
+ * Userspace microbenchmark of the hid-asus frame decoder.
+ *
+ * src/hid-asus.c is compiled as is against the shim headers in
+ * tools/shim, which model the input core closely enough to count the
+ * events a frame really produces. Frames are fed through the driver's
+ * raw_event hook like the HID core does.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include "hid-asus.c"
+
+#include <getopt.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "asus-uhid.h"
+#include "i2c-hid-rec.h"
+
+struct corpus {
+	const char *name;
+	u8 *frames;
+	unsigned long count;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u64 cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static struct hid_device *bench_device(void)
+{
+	const struct hid_device_id *id;
+	struct asus_drvdata *drvdata;
+	struct hid_device *hdev;
+	struct hid_input hi;
+
+	for (id = asus_devices; id->vendor; id++)
+		if (id->product == USB_DEVICE_ID_ASUSTEK_TOUCHPAD)
+			break;
+
+	hdev = calloc(1, sizeof(*hdev));
+	drvdata = calloc(1, sizeof(*drvdata));
+	hi.input = calloc(1, sizeof(*hi.input));
+	if (!hdev || !drvdata || !hi.input)
+		return NULL;
+
+	drvdata->stats = alloc_percpu(struct asus_stats);
+	if (!drvdata->stats)
+		return NULL;
+
+	drvdata->quirks = id->driver_data;
+	hid_set_drvdata(hdev, drvdata);
+
+	if (asus_driver.input_configured(hdev, &hi))
+		return NULL;
+
+	return hdev;
+}
+
+static void bench_device_free(struct hid_device *hdev)
+{
+	struct asus_drvdata *drvdata = hid_get_drvdata(hdev);
+
+	free(drvdata->input->mt);
+	free(drvdata->input);
+	free_percpu(drvdata->stats);
+	free(drvdata);
+	free(hdev);
+}
+
+static void run(const struct corpus *c, int iterations)
+{
+	struct hid_report report = { .id = INPUT_REPORT_ID,
+				     .type = HID_INPUT_REPORT };
+	struct hid_device *hdev = bench_device();
+	struct input_dev *input;
+	unsigned long frames, events;
+	u64 ns, cyc;
+	int i;
+	unsigned long f;
+
+	if (!hdev) {
+		fprintf(stderr, "cannot set up device\n");
+		exit(1);
+	}
+	input = ((struct asus_drvdata *)hid_get_drvdata(hdev))->input;
+
+	/* one untimed pass to settle the tracking IDs and warm the caches */
+	for (f = 0; f < c->count; f++)
+		asus_driver.raw_event(hdev, &report,
+				      c->frames + f * INPUT_REPORT_SIZE,
+				      INPUT_REPORT_SIZE);
+	input->events = 0;
+
+	ns = now_ns();
+	cyc = cycles();
+	for (i = 0; i < iterations; i++)
+		for (f = 0; f < c->count; f++)
+			asus_driver.raw_event(hdev, &report,
+					      c->frames + f * INPUT_REPORT_SIZE,
+					      INPUT_REPORT_SIZE);
+	cyc = cycles() - cyc;
+	ns = now_ns() - ns;
+
+	frames = c->count * iterations;
+	events = input->events;
+
+	printf("%-12s %8lu %10.1f", c->name, c->count, (double)ns / frames);
+#ifdef HAVE_TSC
+	printf(" %12.1f", (double)cyc / frames);
+#else
+	printf(" %12s", "n/a");
+#endif
+	printf(" %12.2f\n", (double)events / frames);
+
+	bench_device_free(hdev);
+}
+
+static u8 *corpus_alloc(unsigned long count)
+{
+	u8 *frames = calloc(count, INPUT_REPORT_SIZE);
+
+	if (!frames) {
+		perror("calloc");
+		exit(1);
+	}
+	return frames;
+}
+
+static void corpus_synthetic(struct corpus *c, const char *name,
+			     unsigned long count, int contacts,
+			     unsigned int palm_mask, int button_every)
+{
+	struct asus_contact slots[ASUS_MAX_CONTACTS];
+	unsigned int mask;
+	unsigned long f;
+
+	c->name = name;
+	c->count = count;
+	c->frames = corpus_alloc(count);
+
+	for (f = 0; f < count; f++) {
+		bool button = button_every && (f / button_every) & 1;
+
+		mask = asus_pattern_step(ASUS_PATTERN_CIRCLE, f, contacts,
+					 palm_mask, slots);
+		asus_frame_build_mask(c->frames + f * INPUT_REPORT_SIZE,
+				      slots, mask, button);
+	}
+}
+
+/* random number of contacts, palms and button state every few frames */
+static void corpus_mixed(struct corpus *c, unsigned long count)
+{
+	struct asus_contact slots[ASUS_MAX_CONTACTS];
+	unsigned int mask = 0, palm = 0;
+	bool button = false;
+	unsigned long f;
+
+	srand(1);
+	c->name = "mixed";
+	c->count = count;
+	c->frames = corpus_alloc(count);
+
+	for (f = 0; f < count; f++) {
+		if (f % 16 == 0) {
+			mask = rand() & 0x1f;
+			palm = rand() & rand() & 0x1f;
+			button = !(rand() % 8);
+		}
+		asus_pattern_step(ASUS_PATTERN_CIRCLE, f, ASUS_MAX_CONTACTS,
+				  palm, slots);
+		asus_frame_build_mask(c->frames + f * INPUT_REPORT_SIZE,
+				      slots, mask, button);
+	}
+}
+
+/* touchpad frames of an i2c-hid flight recorder capture */
+static int corpus_load_capture(struct corpus *c, const char *path)
+{
+	struct hid_rec_capture cap;
+	unsigned long i;
+	int ret;
+
+	ret = hid_rec_load(path, &cap);
+	if (ret)
+		return ret;
+
+	c->name = path;
+	c->count = 0;
+	c->frames = corpus_alloc(cap.count);
+
+	for (i = 0; i < cap.count; i++) {
+		const struct hid_rec_report *r = &cap.reports[i];
+
+		if (r->len != INPUT_REPORT_SIZE || r->data[0] != INPUT_REPORT_ID)
+			continue;
+		memcpy(c->frames + c->count++ * INPUT_REPORT_SIZE, r->data,
+		       INPUT_REPORT_SIZE);
+	}
+
+	hid_rec_free(&cap);
+	return c->count ? 0 : -ENODATA;
+}
+
+/* recorded corpus: raw INPUT_REPORT_ID frames back to back */
+static int corpus_load(struct corpus *c, const char *path)
+{
+	FILE *fp;
+	long size;
+
+	if (hid_rec_probe(path))
+		return corpus_load_capture(c, path);
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -errno;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+
+	c->name = path;
+	c->count = size / INPUT_REPORT_SIZE;
+	c->frames = corpus_alloc(c->count ? c->count : 1);
+	if (fread(c->frames, INPUT_REPORT_SIZE, c->count, fp) != c->count) {
+		fclose(fp);
+		return -EIO;
+	}
+	fclose(fp);
+
+	return c->count ? 0 : -ENODATA;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n FRAMES] [-i ITERATIONS] [-f FILE]...\n"
+		"  -n FRAMES      frames per synthetic corpus (default 4096)\n"
+		"  -i ITERATIONS  passes over each corpus (default 200)\n"
+		"  -f FILE        add a recorded corpus, either raw 28-byte frames\n"
+		"                 or an i2c-hid flight recorder capture\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	static const char * const finger_names[] = {
+		"0-contacts", "1-contact", "2-contacts", "3-contacts",
+		"4-contacts", "5-contacts",
+	};
+	struct corpus corpora[16 + 9];
+	unsigned long count = 4096;
+	int iterations = 200;
+	int n = 0, i, opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:i:f:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'f':
+			if (n >= 16) {
+				fprintf(stderr, "too many corpora\n");
+				return 1;
+			}
+			ret = corpus_load(&corpora[n], optarg);
+			if (ret) {
+				fprintf(stderr, "%s: %s\n", optarg,
+					strerror(-ret));
+				return 1;
+			}
+			n++;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!count || iterations <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i <= ASUS_MAX_CONTACTS; i++)
+		corpus_synthetic(&corpora[n++], finger_names[i], count, i, 0, 0);
+	corpus_synthetic(&corpora[n++], "palm", count, 3, 0x2, 0);
+	corpus_synthetic(&corpora[n++], "button", count, 1, 0, 32);
+	corpus_mixed(&corpora[n++], count);
+
+	printf("%-12s %8s %10s %12s %12s\n", "corpus", "frames", "ns/frame",
+	       "cycles/frame", "events/frame");
+
+	for (i = 0; i < n; i++) {
+		run(&corpora[i], iterations);
+		free(corpora[i].frames);
+	}
+
+	return 0;
+}
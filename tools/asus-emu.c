@@ -0,0 +1,194 @@
+/*
+ * Asus FTE100x touchpad emulator and load generator.
+ *
+ * Creates a uhid device that hid-asus binds to, answers the multitouch
+ * start command and then streams synthetic INPUT_REPORT_ID frames. The
+ * uhid write path runs hid_input_report() and the hid-asus decoder in
+ * our own syscall, so our system time is the kernel cost of the frames.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "asus-uhid.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static double ts_to_s(const struct timespec *ts)
+{
+	return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double tv_to_s(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -r RATE     frames per second, 0 = as fast as possible (default 140)\n"
+		"  -c COUNT    number of contacts, 0-%d (default 2)\n"
+		"  -p MASK     palm bits, bit i marks contact i as palm (default 0)\n"
+		"  -m PATTERN  static, line, circle, random or tap (default circle)\n"
+		"  -b N        press the button every N frames, 0 = never (default 0)\n"
+		"  -d SECONDS  run time, 0 = until interrupted (default 10)\n"
+		"  -w MS       wait for the multitouch start command (default 5000)\n",
+		prog, ASUS_MAX_CONTACTS);
+}
+
+int main(int argc, char **argv)
+{
+	struct asus_contact contacts[ASUS_MAX_CONTACTS];
+	uint8_t frame[ASUS_INPUT_REPORT_SIZE];
+	struct timespec start, end, next;
+	struct rusage ru_start, ru_end;
+	enum asus_pattern pattern = ASUS_PATTERN_CIRCLE;
+	struct asus_uhid dev;
+	unsigned long frames = 0, errors = 0;
+	unsigned int palm_mask = 0, slot_mask;
+	double elapsed, stime, utime;
+	long period_ns = 0;
+	int rate = 140, count = 2, button_every = 0, duration = 10;
+	int wait_ms = 5000;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "r:c:p:m:b:d:w:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			palm_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			ret = asus_pattern_parse(optarg);
+			if (ret < 0) {
+				fprintf(stderr, "unknown pattern %s\n", optarg);
+				return 1;
+			}
+			pattern = ret;
+			break;
+		case 'b':
+			button_every = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'w':
+			wait_ms = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (count < 0 || count > ASUS_MAX_CONTACTS || rate < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	ret = asus_uhid_create(&dev, "uhid-asus FTE1001:00 0B05:0101",
+			       "uhid-asus");
+	if (ret) {
+		fprintf(stderr, "cannot create uhid device: %s\n",
+			strerror(-ret));
+		return 1;
+	}
+
+	ret = asus_uhid_wait_mt(&dev, wait_ms);
+	if (ret == -ETIMEDOUT)
+		fprintf(stderr, "no multitouch start command, is hid-asus bound? "
+			"(see dev-attach.sh)\n");
+	else if (ret)
+		fprintf(stderr, "uhid: %s\n", strerror(-ret));
+
+	printf("streaming %d contact(s), pattern %s, palm mask 0x%x, %d fps\n",
+	       count, asus_pattern_name(pattern), palm_mask, rate);
+
+	if (rate)
+		period_ns = 1000000000L / rate;
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+
+	while (!stop) {
+		bool button = button_every && frames % button_every <
+					      (unsigned long)button_every / 2;
+
+		slot_mask = asus_pattern_step(pattern, frames, count,
+					      palm_mask, contacts);
+		asus_frame_build_mask(frame, contacts, slot_mask, button);
+
+		if (asus_uhid_send(&dev, frame, sizeof(frame)))
+			errors++;
+		frames++;
+
+		/* keep answering get/set report and open/close requests */
+		asus_uhid_poll(&dev, 0);
+
+		if (period_ns) {
+			next.tv_nsec += period_ns;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&next, NULL);
+		}
+
+		if (duration) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			if (ts_to_s(&end) - ts_to_s(&start) >= duration)
+				break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &ru_end);
+
+	/* an empty frame lifts all contacts before the device goes away */
+	asus_frame_build_mask(frame, contacts, 0, false);
+	asus_uhid_send(&dev, frame, sizeof(frame));
+	asus_uhid_destroy(&dev);
+
+	elapsed = ts_to_s(&end) - ts_to_s(&start);
+	stime = tv_to_s(&ru_end.ru_stime) - tv_to_s(&ru_start.ru_stime);
+	utime = tv_to_s(&ru_end.ru_utime) - tv_to_s(&ru_start.ru_utime);
+
+	printf("frames:          %lu (%lu errors)\n", frames, errors);
+	printf("elapsed:         %.3f s\n", elapsed);
+	printf("frames/sec:      %.1f\n", elapsed > 0 ? frames / elapsed : 0);
+	if (frames) {
+		printf("kernel us/frame: %.3f\n", stime * 1e6 / frames);
+		printf("user us/frame:   %.3f\n", utime * 1e6 / frames);
+	}
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * Touch-to-event latency harness for hid-asus.
+ *
+ * Injects timestamped frames through a uhid stand-in touchpad and reads
+ * the resulting events back from its evdev node. For every frame it
+ * records the time from injection to the EV_SYN timestamp assigned by
+ * the input core, and to the moment a reader thread actually received
+ * the EV_SYN. Optional CPU hogs and a high-rate timer thread put the
+ * machine under load while measuring.
+ *
+ * The X position of the single moving contact encodes the frame sequence
+ * number, so every EV_SYN can be matched to its injection time.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <linux/input.h>
+
+#include "asus-uhid.h"
+
+#define SEQ_RING	2048
+#define SEQ_X_BASE	100
+
+struct inject_slot {
+	uint64_t seq;
+	uint64_t ns;
+};
+
+static struct inject_slot ring[SEQ_RING];
+static volatile int done;
+
+static uint64_t *kernel_lat;
+static uint64_t *delivery_lat;
+static unsigned long samples;
+static unsigned long max_samples;
+static unsigned long unmatched;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int find_evdev(const char *phys, int timeout_ms)
+{
+	char path[300], buf[256];
+	struct dirent *de;
+	DIR *dir;
+	int fd, waited;
+
+	for (waited = 0; waited < timeout_ms; waited += 50) {
+		dir = opendir("/dev/input");
+		if (!dir)
+			return -errno;
+
+		while ((de = readdir(dir))) {
+			if (strncmp(de->d_name, "event", 5))
+				continue;
+
+			snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+			fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+			if (fd < 0)
+				continue;
+
+			memset(buf, 0, sizeof(buf));
+			if (ioctl(fd, EVIOCGPHYS(sizeof(buf) - 1), buf) >= 0 &&
+			    !strcmp(buf, phys)) {
+				closedir(dir);
+				return fd;
+			}
+			close(fd);
+		}
+
+		closedir(dir);
+		usleep(50000);
+	}
+
+	return -ENODEV;
+}
+
+static void *reader(void *arg)
+{
+	struct pollfd pfd = { .fd = *(int *)arg, .events = POLLIN };
+	struct input_event ev[64];
+	int x = -1;
+	ssize_t n;
+	int i;
+
+	while (!done) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		n = read(pfd.fd, ev, sizeof(ev));
+		if (n <= 0)
+			continue;
+
+		for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++) {
+			uint64_t recv, ts, seq;
+			struct inject_slot *slot;
+
+			if (ev[i].type == EV_ABS && ev[i].code == ABS_X) {
+				x = ev[i].value;
+				continue;
+			}
+			if (ev[i].type != EV_SYN || ev[i].code != SYN_REPORT ||
+			    x < SEQ_X_BASE)
+				continue;
+
+			recv = now_ns();
+			ts = (uint64_t)ev[i].input_event_sec * 1000000000ULL +
+			     ev[i].input_event_usec * 1000ULL;
+
+			slot = &ring[(x - SEQ_X_BASE) % SEQ_RING];
+			seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (!seq || samples >= max_samples) {
+				unmatched++;
+				continue;
+			}
+
+			/* the evdev clock only has usec resolution */
+			kernel_lat[samples] = ts > slot->ns ? ts - slot->ns : 0;
+			delivery_lat[samples] = recv - slot->ns;
+			samples++;
+			x = -1;
+		}
+	}
+
+	return NULL;
+}
+
+static void *timer_load(void *arg)
+{
+	int hz = *(int *)arg;
+	struct itimerspec its = { 0 };
+	uint64_t expirations;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	its.it_interval.tv_sec = 1 / hz;
+	its.it_interval.tv_nsec = hz > 1 ? 1000000000L / hz : 0;
+	its.it_value = its.it_interval;
+	timerfd_settime(fd, 0, &its, NULL);
+
+	while (!done)
+		if (read(fd, &expirations, sizeof(expirations)) < 0)
+			break;
+
+	close(fd);
+	return NULL;
+}
+
+static pid_t *start_hogs(int n)
+{
+	pid_t *pids = calloc(n, sizeof(*pids));
+	int i;
+
+	for (i = 0; pids && i < n; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			volatile unsigned long spin = 0;
+
+			for (;;)
+				spin++;
+		}
+	}
+
+	return pids;
+}
+
+static void stop_hogs(pid_t *pids, int n)
+{
+	int i;
+
+	for (i = 0; pids && i < n; i++) {
+		if (pids[i] > 0) {
+			kill(pids[i], SIGKILL);
+			waitpid(pids[i], NULL, 0);
+		}
+	}
+	free(pids);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *v, unsigned long n, double p)
+{
+	unsigned long idx = (unsigned long)(p / 100.0 * (n - 1) + 0.5);
+
+	return v[idx] / 1000.0;
+}
+
+static void report(const char *name, uint64_t *v, unsigned long n)
+{
+	double sum = 0;
+	unsigned long i;
+
+	qsort(v, n, sizeof(*v), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += v[i];
+
+	printf("%-10s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+	       v[0] / 1000.0, sum / n / 1000.0, percentile(v, n, 50),
+	       percentile(v, n, 99), percentile(v, n, 99.9), v[n - 1] / 1000.0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -r RATE   injected frames per second (default 140)\n"
+		"  -n COUNT  number of frames to inject (default 10000)\n"
+		"  -c COUNT  number of contacts, 1-%d (default 1)\n"
+		"  -s N      run N CPU hog processes while measuring (default 0)\n"
+		"  -t HZ     run a timer thread firing at HZ for IRQ load (default 0)\n",
+		prog, ASUS_MAX_CONTACTS);
+}
+
+int main(int argc, char **argv)
+{
+	struct asus_contact contacts[ASUS_MAX_CONTACTS];
+	uint8_t frame[ASUS_INPUT_REPORT_SIZE];
+	pthread_t reader_thread, timer_thread;
+	struct timespec next;
+	struct asus_uhid dev;
+	char phys[64];
+	pid_t *hogs = NULL;
+	unsigned long frames = 10000, seq;
+	int rate = 140, count = 1, hog_count = 0, timer_hz = 0;
+	int clk = CLOCK_MONOTONIC;
+	int opt, ret, evfd;
+
+	while ((opt = getopt(argc, argv, "r:n:c:s:t:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 's':
+			hog_count = atoi(optarg);
+			break;
+		case 't':
+			timer_hz = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (rate <= 0 || !frames || count < 1 || count > ASUS_MAX_CONTACTS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	max_samples = frames;
+	kernel_lat = calloc(frames, sizeof(*kernel_lat));
+	delivery_lat = calloc(frames, sizeof(*delivery_lat));
+	if (!kernel_lat || !delivery_lat) {
+		perror("calloc");
+		return 1;
+	}
+
+	snprintf(phys, sizeof(phys), "uhid-asus-latency-%d", getpid());
+	ret = asus_uhid_create(&dev, "uhid-asus FTE1001:00 0B05:0101", phys);
+	if (ret) {
+		fprintf(stderr, "cannot create uhid device: %s\n",
+			strerror(-ret));
+		return 1;
+	}
+
+	ret = asus_uhid_wait_mt(&dev, 5000);
+	if (ret) {
+		fprintf(stderr, "hid-asus did not start multitouch: %s\n",
+			strerror(-ret));
+		goto out_destroy;
+	}
+
+	evfd = find_evdev(phys, 2000);
+	if (evfd < 0) {
+		fprintf(stderr, "cannot find the evdev node for %s\n", phys);
+		ret = evfd;
+		goto out_destroy;
+	}
+	ioctl(evfd, EVIOCSCLOCKID, &clk);
+
+	if (hog_count)
+		hogs = start_hogs(hog_count);
+	if (timer_hz > 0)
+		pthread_create(&timer_thread, NULL, timer_load, &timer_hz);
+	pthread_create(&reader_thread, NULL, reader, &evfd);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (seq = 1; seq <= frames; seq++) {
+		struct inject_slot *slot;
+		unsigned int mask;
+
+		/* the contact in slot 0 stays down and is the pointer */
+		mask = asus_pattern_step(ASUS_PATTERN_STATIC, seq, count, 0,
+					 contacts);
+		contacts[0].x = SEQ_X_BASE + seq % SEQ_RING;
+		asus_frame_build_mask(frame, contacts, mask, false);
+
+		slot = &ring[seq % SEQ_RING];
+		slot->ns = now_ns();
+		__atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+
+		asus_uhid_send(&dev, frame, sizeof(frame));
+		asus_uhid_poll(&dev, 0);
+
+		next.tv_nsec += 1000000000L / rate;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	/* give the reader time to drain the last events */
+	usleep(200000);
+	done = 1;
+	pthread_join(reader_thread, NULL);
+	if (timer_hz > 0)
+		pthread_join(timer_thread, NULL);
+	stop_hogs(hogs, hog_count);
+	close(evfd);
+
+	printf("frames %lu, matched %lu, unmatched %lu, %d hog(s), timer %d Hz\n",
+	       frames, samples, unmatched, hog_count, timer_hz);
+	if (samples) {
+		printf("%-10s %9s %9s %9s %9s %9s %9s\n", "usec", "min",
+		       "mean", "p50", "p99", "p99.9", "max");
+		report("to-EV_SYN", kernel_lat, samples);
+		report("delivered", delivery_lat, samples);
+	}
+
+	ret = 0;
+
+out_destroy:
+	asus_uhid_destroy(&dev);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Replay an i2c-hid flight recorder capture through a uhid touchpad.
+ *
+ * Every recorded input report is written to a uhid stand-in of the Asus
+ * touchpad, either with the original spacing between reports or as fast
+ * as possible. hid-asus decodes them exactly like on the real machine,
+ * so a capture of a misbehaving cursor can be reproduced anywhere.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asus-uhid.h"
+#include "i2c-hid-rec.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] CAPTURE\n"
+		"  -f        replay as fast as possible instead of in real time\n"
+		"  -s SPEED  time scale, 2 replays twice as fast (default 1)\n"
+		"  -l LOOPS  replay the capture LOOPS times, 0 = forever (default 1)\n"
+		"  -w MS     wait for the multitouch start command (default 5000)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t lift[ASUS_INPUT_REPORT_SIZE];
+	struct hid_rec_capture cap;
+	struct asus_uhid dev;
+	unsigned long sent = 0, errors = 0, i;
+	uint64_t start, base;
+	double speed = 1.0;
+	bool fast = false;
+	int loops = 1, loop, wait_ms = 5000;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "fs:l:w:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			fast = true;
+			break;
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'w':
+			wait_ms = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1 || speed <= 0 || loops < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = hid_rec_load(argv[optind], &cap);
+	if (ret) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(-ret));
+		return 1;
+	}
+
+	printf("%lu reports over %.3f s (%lu torn, %lu truncated)\n",
+	       cap.count, (cap.reports[cap.count - 1].timestamp_ns -
+			   cap.reports[0].timestamp_ns) / 1e9,
+	       cap.torn, cap.truncated);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	ret = asus_uhid_create(&dev, "uhid-asus FTE1001:00 0B05:0101",
+			       "uhid-asus-replay");
+	if (ret) {
+		fprintf(stderr, "cannot create uhid device: %s\n",
+			strerror(-ret));
+		hid_rec_free(&cap);
+		return 1;
+	}
+
+	ret = asus_uhid_wait_mt(&dev, wait_ms);
+	if (ret == -ETIMEDOUT)
+		fprintf(stderr, "no multitouch start command, is hid-asus bound?\n");
+	else if (ret)
+		fprintf(stderr, "uhid: %s\n", strerror(-ret));
+
+	start = now_ns();
+
+	for (loop = 0; !stop && (!loops || loop < loops); loop++) {
+		base = now_ns();
+
+		for (i = 0; !stop && i < cap.count; i++) {
+			const struct hid_rec_report *r = &cap.reports[i];
+
+			if (!fast)
+				sleep_until(base + (r->timestamp_ns -
+					    cap.reports[0].timestamp_ns) / speed);
+
+			if (asus_uhid_send(&dev, r->data, r->len))
+				errors++;
+			sent++;
+
+			asus_uhid_poll(&dev, 0);
+		}
+	}
+
+	printf("sent %lu reports (%lu errors) in %.3f s\n", sent, errors,
+	       (now_ns() - start) / 1e9);
+
+	/* lift all contacts before the device goes away */
+	asus_frame_build_mask(lift, NULL, 0, false);
+	asus_uhid_send(&dev, lift, sizeof(lift));
+	asus_uhid_destroy(&dev);
+	hid_rec_free(&cap);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * Userspace stand-in for the Asus i2c touchpad, built on top of uhid.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#include "asus-uhid.h"
+
+#define BTN_LEFT_MASK			0x01
+#define CONTACT_TOOL_TYPE_MASK		0x80
+#define CONTACT_TOUCH_MAJOR_MASK	0x07
+#define CONTACT_PRESSURE_MASK		0x7f
+
+/*
+ * Minimal descriptor exposing the two reports hid-asus cares about:
+ * the 28-byte vendor input report and the 5-byte multitouch feature
+ * report. hid-asus skips the HID input mapping entirely, so the usages
+ * only need to be well formed.
+ */
+static const uint8_t asus_rdesc[] = {
+	0x05, 0x01,			/* Usage Page (Generic Desktop)	*/
+	0x09, 0x02,			/* Usage (Mouse)		*/
+	0xa1, 0x01,			/* Collection (Application)	*/
+	0x06, 0x00, 0xff,		/*  Usage Page (Vendor 0xff00)	*/
+	0x85, ASUS_INPUT_REPORT_ID,	/*  Report ID (0x5d)		*/
+	0x09, 0x01,			/*  Usage (0x01)		*/
+	0x15, 0x00,			/*  Logical Minimum (0)		*/
+	0x26, 0xff, 0x00,		/*  Logical Maximum (255)	*/
+	0x75, 0x08,			/*  Report Size (8)		*/
+	0x95, ASUS_INPUT_REPORT_SIZE - 1, /* Report Count (27)	*/
+	0x81, 0x02,			/*  Input (Data,Var,Abs)	*/
+	0x85, ASUS_FEATURE_REPORT_ID,	/*  Report ID (0x0d)		*/
+	0x09, 0x02,			/*  Usage (0x02)		*/
+	0x95, 0x04,			/*  Report Count (4)		*/
+	0xb1, 0x02,			/*  Feature (Data,Var,Abs)	*/
+	0xc0,				/* End Collection		*/
+};
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+	ssize_t ret = write(fd, ev, sizeof(*ev));
+
+	if (ret < 0)
+		return -errno;
+	if (ret != sizeof(*ev))
+		return -EFAULT;
+	return 0;
+}
+
+int asus_uhid_create(struct asus_uhid *dev, const char *name,
+		     const char *phys)
+{
+	struct uhid_event ev;
+	int ret;
+
+	memset(dev, 0, sizeof(*dev));
+
+	dev->fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (dev->fd < 0)
+		return -errno;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name),
+		 "%s", name);
+	snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys),
+		 "%s", phys);
+	memcpy(ev.u.create2.rd_data, asus_rdesc, sizeof(asus_rdesc));
+	ev.u.create2.rd_size = sizeof(asus_rdesc);
+	ev.u.create2.bus = BUS_I2C;
+	ev.u.create2.vendor = USB_VENDOR_ID_ASUSTEK;
+	ev.u.create2.product = USB_DEVICE_ID_ASUSTEK_TOUCHPAD;
+	ev.u.create2.version = 0x0100;
+
+	ret = uhid_write(dev->fd, &ev);
+	if (ret) {
+		close(dev->fd);
+		dev->fd = -1;
+	}
+
+	return ret;
+}
+
+void asus_uhid_destroy(struct asus_uhid *dev)
+{
+	struct uhid_event ev;
+
+	if (dev->fd < 0)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(dev->fd, &ev);
+	close(dev->fd);
+	dev->fd = -1;
+}
+
+static int asus_uhid_handle(struct asus_uhid *dev, const struct uhid_event *ev)
+{
+	struct uhid_event reply;
+
+	memset(&reply, 0, sizeof(reply));
+
+	switch (ev->type) {
+	case UHID_START:
+		dev->started = true;
+		break;
+	case UHID_STOP:
+		dev->started = false;
+		dev->mt_enabled = false;
+		break;
+	case UHID_OPEN:
+		dev->opened = true;
+		break;
+	case UHID_CLOSE:
+		dev->opened = false;
+		break;
+	case UHID_SET_REPORT:
+		dev->set_reports++;
+		if (ev->u.set_report.rtype == UHID_FEATURE_REPORT &&
+		    ev->u.set_report.rnum == ASUS_FEATURE_REPORT_ID)
+			dev->mt_enabled = true;
+		reply.type = UHID_SET_REPORT_REPLY;
+		reply.u.set_report_reply.id = ev->u.set_report.id;
+		reply.u.set_report_reply.err = 0;
+		return uhid_write(dev->fd, &reply);
+	case UHID_GET_REPORT:
+		/* The real device is never asked, hid-asus sets NO_INIT_REPORTS */
+		dev->get_reports++;
+		reply.type = UHID_GET_REPORT_REPLY;
+		reply.u.get_report_reply.id = ev->u.get_report.id;
+		reply.u.get_report_reply.err = EIO;
+		return uhid_write(dev->fd, &reply);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+int asus_uhid_poll(struct asus_uhid *dev, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = dev->fd, .events = POLLIN };
+	struct uhid_event ev;
+	int handled = 0;
+	int ret;
+
+	for (;;) {
+		ret = poll(&pfd, 1, handled ? 0 : timeout_ms);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (!ret)
+			return handled;
+
+		if (read(dev->fd, &ev, sizeof(ev)) < 0)
+			return -errno;
+
+		ret = asus_uhid_handle(dev, &ev);
+		if (ret)
+			return ret;
+		handled++;
+	}
+}
+
+static long elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 +
+		(now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+int asus_uhid_wait_mt(struct asus_uhid *dev, int timeout_ms)
+{
+	struct timespec start;
+	long left;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (!dev->mt_enabled) {
+		left = timeout_ms - elapsed_ms(&start);
+		if (left <= 0)
+			return -ETIMEDOUT;
+
+		ret = asus_uhid_poll(dev, left);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int asus_uhid_send(struct asus_uhid *dev, const uint8_t *data, int size)
+{
+	struct uhid_event ev;
+
+	if (size < 0 || size > UHID_DATA_MAX)
+		return -EINVAL;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_INPUT2;
+	ev.u.input2.size = size;
+	memcpy(ev.u.input2.data, data, size);
+
+	/* Only write the used part, uhid accepts short UHID_INPUT2 events */
+	if (write(dev->fd, &ev, offsetof(struct uhid_event, u.input2.data) +
+		  size) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static void asus_contact_encode(uint8_t *c, const struct asus_contact *contact)
+{
+	int x = contact->x;
+	int y = ASUS_MAX_Y - contact->y;
+
+	if (x < 0)
+		x = 0;
+	if (x > ASUS_MAX_X)
+		x = ASUS_MAX_X;
+	if (y < 0)
+		y = 0;
+	if (y > ASUS_MAX_Y)
+		y = ASUS_MAX_Y;
+
+	c[0] = ((x >> 4) & 0xf0) | ((y >> 8) & 0x0f);
+	c[1] = x & 0xff;
+	c[2] = y & 0xff;
+	c[3] = (contact->touch_major & CONTACT_TOUCH_MAJOR_MASK) << 4;
+	if (contact->palm)
+		c[3] |= CONTACT_TOOL_TYPE_MASK;
+	c[4] = contact->pressure & CONTACT_PRESSURE_MASK;
+}
+
+void asus_frame_build_mask(uint8_t *frame, const struct asus_contact *contacts,
+			   unsigned int slot_mask, bool button)
+{
+	uint8_t *c = frame + 2;
+	int i;
+
+	memset(frame, 0, ASUS_INPUT_REPORT_SIZE);
+	frame[0] = ASUS_INPUT_REPORT_ID;
+	if (button)
+		frame[1] |= BTN_LEFT_MASK;
+
+	for (i = 0; i < ASUS_MAX_CONTACTS; i++) {
+		if (!(slot_mask & (1u << i)))
+			continue;
+
+		frame[1] |= 1u << (i + 3);
+		asus_contact_encode(c, &contacts[i]);
+		c += ASUS_CONTACT_DATA_SIZE;
+	}
+}
+
+void asus_frame_build(uint8_t *frame, const struct asus_contact *contacts,
+		      int count, bool button)
+{
+	if (count > ASUS_MAX_CONTACTS)
+		count = ASUS_MAX_CONTACTS;
+	if (count < 0)
+		count = 0;
+
+	asus_frame_build_mask(frame, contacts, (1u << count) - 1, button);
+}
+
+static const char * const asus_pattern_names[] = {
+	[ASUS_PATTERN_STATIC]	= "static",
+	[ASUS_PATTERN_LINE]	= "line",
+	[ASUS_PATTERN_CIRCLE]	= "circle",
+	[ASUS_PATTERN_RANDOM]	= "random",
+	[ASUS_PATTERN_TAP]	= "tap",
+};
+
+int asus_pattern_parse(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(asus_pattern_names) / sizeof(*asus_pattern_names); i++)
+		if (!strcmp(name, asus_pattern_names[i]))
+			return i;
+
+	return -EINVAL;
+}
+
+const char *asus_pattern_name(enum asus_pattern pattern)
+{
+	return asus_pattern_names[pattern];
+}
+
+unsigned int asus_pattern_step(enum asus_pattern pattern, unsigned long frame,
+			       int count, unsigned int palm_mask,
+			       struct asus_contact *contacts)
+{
+	unsigned int mask = (1u << count) - 1;
+	double phase = frame / 120.0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct asus_contact *c = &contacts[i];
+		int cx = ASUS_MAX_X * (i + 1) / (count + 1);
+		int cy = ASUS_MAX_Y / 2;
+
+		c->palm = palm_mask & (1u << i);
+		c->touch_major = 2 + i % 4;
+		c->pressure = 40 + i * 10;
+
+		switch (pattern) {
+		case ASUS_PATTERN_STATIC:
+		case ASUS_PATTERN_TAP:
+			c->x = cx;
+			c->y = cy;
+			break;
+		case ASUS_PATTERN_LINE:
+			c->x = cx;
+			c->y = (frame * 8 + i * 100) % ASUS_MAX_Y;
+			break;
+		case ASUS_PATTERN_CIRCLE:
+			c->x = cx + 300 * cos(phase + i);
+			c->y = cy + 300 * sin(phase + i);
+			break;
+		case ASUS_PATTERN_RANDOM:
+			c->x = rand() % ASUS_MAX_X;
+			c->y = rand() % ASUS_MAX_Y;
+			c->pressure = rand() % ASUS_MAX_PRESSURE;
+			break;
+		}
+	}
+
+	/* tap: 10 frames down, 10 frames up */
+	if (pattern == ASUS_PATTERN_TAP && (frame / 10) & 1)
+		mask = 0;
+
+	return mask;
+}
@@ -0,0 +1,97 @@
+/*
+ * Userspace stand-in for the Asus i2c touchpad, built on top of uhid.
+ *
+ * The frame layout mirrors what asus_report_input() in src/hid-asus.c
+ * decodes, so any change to the decoder has to be reflected here.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#ifndef ASUS_UHID_H_FILE
+#define ASUS_UHID_H_FILE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hid-ids.h"
+
+#define ASUS_FEATURE_REPORT_ID		0x0d
+#define ASUS_INPUT_REPORT_ID		0x5d
+
+#define ASUS_INPUT_REPORT_SIZE		28
+#define ASUS_MAX_CONTACTS		5
+#define ASUS_CONTACT_DATA_SIZE		5
+
+#define ASUS_MAX_X			2794
+#define ASUS_MAX_Y			1758
+#define ASUS_MAX_TOUCH_MAJOR		8
+#define ASUS_MAX_PRESSURE		128
+
+struct asus_contact {
+	int x;
+	int y;
+	int touch_major;
+	int pressure;
+	bool palm;
+};
+
+enum asus_pattern {
+	ASUS_PATTERN_STATIC,
+	ASUS_PATTERN_LINE,
+	ASUS_PATTERN_CIRCLE,
+	ASUS_PATTERN_RANDOM,
+	ASUS_PATTERN_TAP,
+};
+
+struct asus_uhid {
+	int fd;
+	bool started;
+	bool opened;
+	bool mt_enabled;		/* got the FEATURE_REPORT_ID start command */
+	unsigned long set_reports;
+	unsigned long get_reports;
+};
+
+int asus_uhid_create(struct asus_uhid *dev, const char *name,
+		     const char *phys);
+void asus_uhid_destroy(struct asus_uhid *dev);
+
+/*
+ * Service pending uhid events (start/open/close/get and set report).
+ * Waits up to @timeout_ms for the first event, -1 blocks.
+ * Returns the number of events handled or a negative errno.
+ */
+int asus_uhid_poll(struct asus_uhid *dev, int timeout_ms);
+
+/* Wait until hid-asus has sent the multitouch start command */
+int asus_uhid_wait_mt(struct asus_uhid *dev, int timeout_ms);
+
+int asus_uhid_send(struct asus_uhid *dev, const uint8_t *data, int size);
+
+/*
+ * Encode @count contacts (at most ASUS_MAX_CONTACTS) into a 28-byte
+ * INPUT_REPORT_ID frame. Slots with a contact are filled from slot 0 up.
+ */
+void asus_frame_build(uint8_t *frame, const struct asus_contact *contacts,
+		      int count, bool button);
+
+/* Same as asus_frame_build but with an explicit slot mask (bit i = slot i) */
+void asus_frame_build_mask(uint8_t *frame, const struct asus_contact *contacts,
+			   unsigned int slot_mask, bool button);
+
+int asus_pattern_parse(const char *name);
+const char *asus_pattern_name(enum asus_pattern pattern);
+
+/*
+ * Move @count contacts (slots 0..count-1) to their position for @frame.
+ * Contacts in @palm_mask are reported as palms.
+ * Returns the slot mask to pass to asus_frame_build_mask().
+ */
+unsigned int asus_pattern_step(enum asus_pattern pattern, unsigned long frame,
+			       int count, unsigned int palm_mask,
+			       struct asus_contact *contacts);
+
+#endif
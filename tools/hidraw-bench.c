@@ -0,0 +1,285 @@
+/*
+ * Concurrent feature report benchmark for hidraw.
+ *
+ * Runs N client processes, each with its own file descriptor on the same
+ * /dev/hidrawX, issuing HIDIOCGFEATURE back to back for a fixed time, and
+ * prints the total and per-client throughput and the latency distribution
+ * for every client count. Every reply is checked for the requested report
+ * ID and the length of the first reply, so replies that got mixed up
+ * between clients show up as bad.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/hidraw.h>
+
+#define MAX_CLIENTS	64
+#define MAX_REPORT	4096
+
+/* filled in by each client, in memory shared with the parent */
+struct client_result {
+	unsigned long ops;
+	unsigned long errors;
+	unsigned long bad;
+	unsigned long samples;
+	uint64_t elapsed_ns;
+	uint64_t lat[];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void client(const char *path, int id, int size, int seconds,
+		   volatile int *go, struct client_result *res,
+		   unsigned long max_samples)
+{
+	uint8_t buf[MAX_REPORT];
+	uint64_t start, end, t0, t1;
+	int fd, ret, len = -1;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		_exit(1);
+	}
+
+	while (!__atomic_load_n(go, __ATOMIC_ACQUIRE))
+		usleep(1000);
+
+	start = now_ns();
+	end = start + seconds * 1000000000ULL;
+
+	for (t0 = start; t0 < end; t0 = t1) {
+		buf[0] = id;
+		ret = ioctl(fd, HIDIOCGFEATURE(size), buf);
+		t1 = now_ns();
+
+		if (ret < 0) {
+			res->errors++;
+			continue;
+		}
+
+		/* every reply of a report has the same length */
+		if (len < 0)
+			len = ret;
+		if (ret != len || (id && buf[0] != id))
+			res->bad++;
+
+		res->ops++;
+		if (res->samples < max_samples)
+			res->lat[res->samples++] = t1 - t0;
+	}
+
+	res->elapsed_ns = now_ns() - start;
+	close(fd);
+	_exit(0);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *v, unsigned long n, double p)
+{
+	unsigned long idx = (unsigned long)(p / 100.0 * (n - 1) + 0.5);
+
+	return v[idx] / 1000.0;
+}
+
+static int run(const char *path, int id, int size, int nr_clients,
+	       int seconds, unsigned long max_samples)
+{
+	size_t res_size = sizeof(struct client_result) +
+			  max_samples * sizeof(uint64_t);
+	unsigned long ops = 0, errors = 0, bad = 0, n = 0;
+	double min_rate = 0, max_rate = 0, elapsed = 0;
+	pid_t pids[MAX_CLIENTS];
+	uint64_t *lat;
+	volatile int *go;
+	void *shm;
+	int i, status, failed = 0;
+
+	shm = mmap(NULL, sizeof(int) + nr_clients * res_size,
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	go = shm;
+
+#define RESULT(i) ((struct client_result *)((char *)shm + sizeof(int) + \
+					       (i) * res_size))
+
+	for (i = 0; i < nr_clients; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0)
+			client(path, id, size, seconds, go, RESULT(i),
+			       max_samples);
+		if (pids[i] < 0) {
+			perror("fork");
+			nr_clients = i;
+			failed = 1;
+			break;
+		}
+	}
+
+	/* start all clients together once they opened the device */
+	usleep(100000);
+	__atomic_store_n(go, 1, __ATOMIC_RELEASE);
+
+	for (i = 0; i < nr_clients; i++) {
+		waitpid(pids[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	}
+
+	if (failed) {
+		munmap(shm, sizeof(int) + nr_clients * res_size);
+		return -1;
+	}
+
+	for (i = 0; i < nr_clients; i++)
+		n += RESULT(i)->samples;
+
+	lat = calloc(n ? n : 1, sizeof(*lat));
+	if (!lat) {
+		perror("calloc");
+		munmap(shm, sizeof(int) + nr_clients * res_size);
+		return -1;
+	}
+
+	for (i = 0, n = 0; i < nr_clients; i++) {
+		struct client_result *res = RESULT(i);
+		double rate = res->ops * 1e9 / res->elapsed_ns;
+
+		if (!i || rate < min_rate)
+			min_rate = rate;
+		if (!i || rate > max_rate)
+			max_rate = rate;
+
+		ops += res->ops;
+		errors += res->errors;
+		bad += res->bad;
+		if (res->elapsed_ns / 1e9 > elapsed)
+			elapsed = res->elapsed_ns / 1e9;
+
+		memcpy(lat + n, res->lat, res->samples * sizeof(*lat));
+		n += res->samples;
+	}
+
+#undef RESULT
+
+	printf("%7d %10.0f %9.0f %9.0f", nr_clients, ops / elapsed,
+	       min_rate, max_rate);
+	if (n) {
+		qsort(lat, n, sizeof(*lat), cmp_u64);
+		printf(" %9.1f %9.1f %9.1f", percentile(lat, n, 50),
+		       percentile(lat, n, 99), lat[n - 1] / 1000.0);
+	} else {
+		printf(" %9s %9s %9s", "-", "-", "-");
+	}
+	printf(" %8lu %8lu\n", errors, bad);
+
+	free(lat);
+	munmap(shm, sizeof(int) + nr_clients * res_size);
+	return bad ? 1 : 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] /dev/hidrawX\n"
+		"  -r ID     feature report ID (default 0x0d, the i2c-hid-sim one)\n"
+		"  -s SIZE   report size including the ID byte (default 5)\n"
+		"  -c LIST   comma separated client counts, up to %d (default 1,2,4,8)\n"
+		"  -t SECS   run time per client count (default 2)\n"
+		"  -n COUNT  latency samples kept per client (default 100000)\n",
+		prog, MAX_CLIENTS);
+}
+
+int main(int argc, char **argv)
+{
+	char clients[256] = "1,2,4,8";
+	unsigned long max_samples = 100000;
+	int id = 0x0d, size = 5, seconds = 2;
+	int opt, ret = 0, nr;
+	char *tok;
+
+	while ((opt = getopt(argc, argv, "r:s:c:t:n:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			id = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'c':
+			snprintf(clients, sizeof(clients), "%s", optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			max_samples = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1 || id < 0 || id > 255 || size < 1 ||
+	    size > MAX_REPORT || seconds <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("%s report 0x%02x, %d bytes, %d s per run\n", argv[optind], id,
+	       size, seconds);
+	printf("%7s %10s %9s %9s %9s %9s %9s %8s %8s\n", "clients", "reads/s",
+	       "min/cl", "max/cl", "p50 us", "p99 us", "max us", "errors",
+	       "bad");
+
+	for (tok = strtok(clients, ","); tok; tok = strtok(NULL, ",")) {
+		nr = atoi(tok);
+		if (nr < 1 || nr > MAX_CLIENTS) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		switch (run(argv[optind], id, size, nr, seconds, max_samples)) {
+		case 0:
+			break;
+		case 1:
+			ret = 1;
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,145 @@
+/*
+ * Reader for captures of the i2c-hid flight recorder.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c-hid-rec.h"
+
+static int read_file(const char *path, uint8_t **buf, size_t *size)
+{
+	size_t len = 0, alloc = 1 << 16;
+	uint8_t *p, *np;
+	FILE *fp;
+	size_t n;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return errno ? -errno : -EIO;
+
+	p = malloc(alloc);
+	if (!p) {
+		fclose(fp);
+		return -ENOMEM;
+	}
+
+	/* debugfs files cannot be sized with fseek, just read until EOF */
+	while ((n = fread(p + len, 1, alloc - len, fp)) > 0) {
+		len += n;
+		if (len < alloc)
+			continue;
+		alloc *= 2;
+		np = realloc(p, alloc);
+		if (!np) {
+			free(p);
+			fclose(fp);
+			return -ENOMEM;
+		}
+		p = np;
+	}
+
+	if (ferror(fp)) {
+		free(p);
+		fclose(fp);
+		return -EIO;
+	}
+
+	fclose(fp);
+	*buf = p;
+	*size = len;
+	return 0;
+}
+
+int hid_rec_probe(const char *path)
+{
+	struct i2c_hid_rec_header hdr;
+	FILE *fp = fopen(path, "rb");
+	int ret;
+
+	if (!fp)
+		return 0;
+
+	ret = fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+	      hdr.magic == I2C_HID_REC_MAGIC;
+	fclose(fp);
+
+	return ret;
+}
+
+int hid_rec_load(const char *path, struct hid_rec_capture *cap)
+{
+	const struct i2c_hid_rec_header *hdr;
+	const struct i2c_hid_rec_slot *slot;
+	uint64_t first, n;
+	uint8_t *buf;
+	size_t size;
+	int ret;
+
+	memset(cap, 0, sizeof(*cap));
+
+	ret = read_file(path, &buf, &size);
+	if (ret)
+		return ret;
+
+	hdr = (const struct i2c_hid_rec_header *)buf;
+	if (size < sizeof(*hdr) || hdr->magic != I2C_HID_REC_MAGIC ||
+	    hdr->version != I2C_HID_REC_VERSION ||
+	    hdr->slot_size != sizeof(*slot) || !hdr->nr_slots ||
+	    hdr->nr_slots & (hdr->nr_slots - 1) ||
+	    size < sizeof(*hdr) + (size_t)hdr->nr_slots * sizeof(*slot)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	first = hdr->head > hdr->nr_slots ? hdr->head - hdr->nr_slots : 0;
+	cap->reports = calloc(hdr->head - first + 1, sizeof(*cap->reports));
+	if (!cap->reports) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (n = first; n < hdr->head; n++) {
+		struct hid_rec_report *r = &cap->reports[cap->count];
+
+		slot = (const struct i2c_hid_rec_slot *)(hdr + 1) +
+		       (n & (hdr->nr_slots - 1));
+
+		/* a capture of a live recorder may have newer slots */
+		if (slot->seq != n + 1) {
+			cap->torn++;
+			continue;
+		}
+		if (slot->len > sizeof(slot->data)) {
+			cap->truncated++;
+			continue;
+		}
+
+		r->timestamp_ns = slot->timestamp_ns;
+		r->len = slot->len;
+		memcpy(r->data, slot->data, slot->len);
+		cap->count++;
+	}
+
+	ret = cap->count ? 0 : -ENODATA;
+
+out:
+	free(buf);
+	if (ret)
+		hid_rec_free(cap);
+	return ret;
+}
+
+void hid_rec_free(struct hid_rec_capture *cap)
+{
+	free(cap->reports);
+	cap->reports = NULL;
+	cap->count = 0;
+}
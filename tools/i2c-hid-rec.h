@@ -0,0 +1,40 @@
+/*
+ * Reader for captures of the i2c-hid flight recorder.
+ *
+ * A capture is a copy of /sys/kernel/debug/i2c_hid/<device>/recorder, see
+ * src/i2c-hid-recorder.h for the layout.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#ifndef I2C_HID_REC_H_FILE
+#define I2C_HID_REC_H_FILE
+
+#include <stdint.h>
+
+#include "i2c-hid-recorder.h"
+
+struct hid_rec_report {
+	uint64_t timestamp_ns;
+	uint16_t len;
+	uint8_t data[I2C_HID_REC_DATA_SIZE];
+};
+
+struct hid_rec_capture {
+	struct hid_rec_report *reports;	/* oldest first */
+	unsigned long count;
+	unsigned long torn;		/* slots overwritten while copying */
+	unsigned long truncated;	/* reports longer than a slot */
+};
+
+/* returns 1 if the file looks like a recorder capture */
+int hid_rec_probe(const char *path);
+
+/* 0 or a negative errno */
+int hid_rec_load(const char *path, struct hid_rec_capture *cap);
+void hid_rec_free(struct hid_rec_capture *cap);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * Userspace stand-in for the parts of the HID core used by hid drivers.
+ */
+
+#ifndef SHIM_LINUX_HID_H
+#define SHIM_LINUX_HID_H
+
+#include <linux/input.h>
+
+#define HID_INPUT_REPORT	0
+#define HID_OUTPUT_REPORT	1
+#define HID_FEATURE_REPORT	2
+
+#define HID_REQ_GET_REPORT	0x01
+#define HID_REQ_SET_REPORT	0x09
+
+#define HID_CONNECT_DEFAULT	0x3f
+#define HID_QUIRK_NO_INIT_REPORTS	BIT(29)
+
+#define HID_ANY_ID		(~0)
+
+struct hid_device {
+	struct device dev;
+	unsigned long quirks;
+	void *drvdata;
+};
+
+#define to_hid_device(pdev) container_of(pdev, struct hid_device, dev)
+
+struct hid_report {
+	unsigned int id;
+	unsigned int type;
+};
+
+struct hid_field;
+struct hid_usage;
+
+struct hid_input {
+	struct input_dev *input;
+};
+
+struct hid_device_id {
+	__u16 bus;
+	__u32 vendor;
+	__u32 product;
+	unsigned long driver_data;
+};
+
+#define HID_I2C_DEVICE(ven, prod) \
+	.bus = BUS_I2C, .vendor = (ven), .product = (prod)
+
+struct hid_driver {
+	const char *name;
+	const struct hid_device_id *id_table;
+	__u8 *(*report_fixup)(struct hid_device *hdev, __u8 *buf,
+			      unsigned int *size);
+	int (*probe)(struct hid_device *dev, const struct hid_device_id *id);
+	void (*remove)(struct hid_device *dev);
+	int (*input_mapping)(struct hid_device *hdev, struct hid_input *hidinput,
+			     struct hid_field *field, struct hid_usage *usage,
+			     unsigned long **bit, int *max);
+	int (*input_configured)(struct hid_device *hdev,
+				struct hid_input *hidinput);
+	int (*reset_resume)(struct hid_device *hdev);
+	int (*raw_event)(struct hid_device *hdev, struct hid_report *report,
+			 u8 *data, int size);
+};
+
+#define module_hid_driver(drv)
+
+#define hid_err(hdev, fmt, ...)		fprintf(stderr, fmt, ##__VA_ARGS__)
+#define hid_warn(hdev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define hid_info(hdev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+
+static inline void *hid_get_drvdata(struct hid_device *hdev)
+{
+	return hdev->drvdata;
+}
+
+static inline void hid_set_drvdata(struct hid_device *hdev, void *data)
+{
+	hdev->drvdata = data;
+}
+
+static inline int hid_parse(struct hid_device *hdev)
+{
+	(void)hdev;
+	return 0;
+}
+
+static inline int hid_hw_start(struct hid_device *hdev, unsigned int mask)
+{
+	(void)hdev;
+	(void)mask;
+	return 0;
+}
+
+static inline void hid_hw_stop(struct hid_device *hdev)
+{
+	(void)hdev;
+}
+
+static inline int hid_hw_raw_request(struct hid_device *hdev,
+				     unsigned char reportnum, __u8 *buf,
+				     size_t len, unsigned char rtype,
+				     int reqtype)
+{
+	(void)hdev;
+	(void)reportnum;
+	(void)buf;
+	(void)rtype;
+	(void)reqtype;
+	return len;
+}
+
+#endif
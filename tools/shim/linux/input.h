@@ -0,0 +1,134 @@
+/*
+ * Userspace model of the input core event path.
+ *
+ * Events are filtered like input_handle_event() does: unchanged absolute
+ * values and key states are dropped, and ABS_MT_SLOT is only emitted when
+ * a multitouch value changes in another slot than the last reported one.
+ * Events that survive the filter are counted in the device.
+ */
+
+#ifndef SHIM_LINUX_INPUT_H
+#define SHIM_LINUX_INPUT_H
+
+#include_next <linux/input.h>
+
+#include "../shim.h"
+
+#define ABS_MT_FIRST		ABS_MT_TOUCH_MAJOR
+#define ABS_MT_LAST		ABS_MT_TOOL_Y
+
+struct input_absinfo_shim {
+	int value;
+	int minimum;
+	int maximum;
+};
+
+struct input_mt;
+
+enum input_clock_type {
+	INPUT_CLK_REAL,
+	INPUT_CLK_MONO,
+	INPUT_CLK_BOOT,
+	INPUT_CLK_MAX
+};
+
+struct input_dev {
+	const char *name;
+
+	unsigned long keybit[BITS_TO_LONGS(KEY_CNT)];
+	unsigned long absbit[BITS_TO_LONGS(ABS_CNT)];
+	unsigned long propbit[BITS_TO_LONGS(INPUT_PROP_CNT)];
+	unsigned long key[BITS_TO_LONGS(KEY_CNT)];
+
+	struct input_absinfo_shim absinfo[ABS_CNT];
+	struct input_mt *mt;
+
+	ktime_t timestamp[INPUT_CLK_MAX];
+
+	/* statistics */
+	unsigned long events;
+	unsigned long syncs;
+};
+
+static void input_mt_handle_abs(struct input_dev *dev, unsigned int code,
+			       int value);
+
+static inline void input_event(struct input_dev *dev, unsigned int type,
+			       unsigned int code, int value)
+{
+	switch (type) {
+	case EV_ABS:
+		if (code == ABS_MT_SLOT || (code >= ABS_MT_FIRST &&
+					    code <= ABS_MT_LAST)) {
+			input_mt_handle_abs(dev, code, value);
+			return;
+		}
+		if (dev->absinfo[code].value == value)
+			return;
+		dev->absinfo[code].value = value;
+		dev->events++;
+		break;
+	case EV_KEY:
+		if (!!test_bit(code, dev->key) == !!value)
+			return;
+		if (value)
+			__set_bit(code, dev->key);
+		else
+			__clear_bit(code, dev->key);
+		dev->events++;
+		break;
+	case EV_SYN:
+		dev->events++;
+		dev->syncs++;
+		dev->timestamp[INPUT_CLK_MONO] = 0;
+		break;
+	default:
+		dev->events++;
+		break;
+	}
+}
+
+static inline void input_report_abs(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_ABS, code, value);
+}
+
+static inline void input_report_key(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_KEY, code, !!value);
+}
+
+static inline void input_sync(struct input_dev *dev)
+{
+	input_event(dev, EV_SYN, SYN_REPORT, 0);
+}
+
+static inline ktime_t *input_get_timestamp(struct input_dev *dev)
+{
+	if (!dev->timestamp[INPUT_CLK_MONO])
+		dev->timestamp[INPUT_CLK_MONO] = ktime_get();
+	return dev->timestamp;
+}
+
+static inline void input_set_capability(struct input_dev *dev,
+					unsigned int type, unsigned int code)
+{
+	if (type == EV_KEY)
+		__set_bit(code, dev->keybit);
+}
+
+static inline void input_set_abs_params(struct input_dev *dev,
+					unsigned int axis, int min, int max,
+					int fuzz, int flat)
+{
+	(void)fuzz;
+	(void)flat;
+	dev->absinfo[axis].minimum = min;
+	dev->absinfo[axis].maximum = max;
+	__set_bit(EV_ABS, dev->absbit);
+	__set_bit(axis, dev->absbit);
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Userspace model of the multitouch slot helpers (drivers/input/input-mt.c).
+ */
+
+#ifndef SHIM_LINUX_INPUT_MT_H
+#define SHIM_LINUX_INPUT_MT_H
+
+#include <linux/input.h>
+
+#define TRKID_MAX		0xffff
+
+#define INPUT_MT_POINTER	0x0001
+#define INPUT_MT_DIRECT		0x0002
+#define INPUT_MT_DROP_UNUSED	0x0004
+#define INPUT_MT_TRACK		0x0008
+
+struct input_mt_slot {
+	int abs[ABS_MT_LAST - ABS_MT_FIRST + 1];
+	unsigned int frame;
+};
+
+struct input_mt {
+	int trkid;
+	int num_slots;
+	int slot;
+	int reported_slot;
+	unsigned int flags;
+	unsigned int frame;
+	struct input_mt_slot slots[];
+};
+
+static inline int input_mt_get_value(const struct input_mt_slot *slot,
+				     unsigned int code)
+{
+	return slot->abs[code - ABS_MT_FIRST];
+}
+
+static inline void input_mt_set_value(struct input_mt_slot *slot,
+				      unsigned int code, int value)
+{
+	slot->abs[code - ABS_MT_FIRST] = value;
+}
+
+static inline bool input_mt_is_active(const struct input_mt_slot *slot)
+{
+	return input_mt_get_value(slot, ABS_MT_TRACKING_ID) >= 0;
+}
+
+static inline int input_mt_new_trkid(struct input_mt *mt)
+{
+	return mt->trkid++ & TRKID_MAX;
+}
+
+static inline int input_mt_init_slots(struct input_dev *dev,
+				      unsigned int num_slots,
+				      unsigned int flags)
+{
+	struct input_mt *mt;
+	unsigned int i;
+
+	mt = calloc(1, sizeof(*mt) + num_slots * sizeof(mt->slots[0]));
+	if (!mt)
+		return -ENOMEM;
+
+	mt->num_slots = num_slots;
+	mt->flags = flags;
+	mt->reported_slot = -1;
+	for (i = 0; i < num_slots; i++)
+		input_mt_set_value(&mt->slots[i], ABS_MT_TRACKING_ID, -1);
+
+	if (flags & INPUT_MT_POINTER) {
+		__set_bit(BTN_TOUCH, dev->keybit);
+		__set_bit(BTN_TOOL_FINGER, dev->keybit);
+		__set_bit(BTN_TOOL_DOUBLETAP, dev->keybit);
+		__set_bit(ABS_X, dev->absbit);
+		__set_bit(ABS_Y, dev->absbit);
+		if (test_bit(ABS_MT_PRESSURE, dev->absbit))
+			__set_bit(ABS_PRESSURE, dev->absbit);
+	}
+
+	dev->mt = mt;
+	return 0;
+}
+
+/* input_handle_abs_event() for the multitouch axes */
+static void input_mt_handle_abs(struct input_dev *dev, unsigned int code,
+			       int value)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *slot;
+
+	if (!mt)
+		return;
+
+	if (code == ABS_MT_SLOT) {
+		if (value >= 0 && value < mt->num_slots)
+			mt->slot = value;
+		return;
+	}
+
+	slot = &mt->slots[mt->slot];
+	if (input_mt_get_value(slot, code) == value)
+		return;
+
+	input_mt_set_value(slot, code, value);
+	if (mt->reported_slot != mt->slot) {
+		mt->reported_slot = mt->slot;
+		dev->events++;		/* the implicit ABS_MT_SLOT event */
+	}
+	dev->events++;
+}
+
+static inline void input_mt_slot(struct input_dev *dev, int slot)
+{
+	input_event(dev, EV_ABS, ABS_MT_SLOT, slot);
+}
+
+static inline bool input_mt_report_slot_state(struct input_dev *dev,
+					      unsigned int tool_type,
+					      bool active)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *slot;
+	int id;
+
+	if (!mt)
+		return false;
+
+	slot = &mt->slots[mt->slot];
+	slot->frame = mt->frame;
+
+	if (!active) {
+		input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		return false;
+	}
+
+	id = input_mt_get_value(slot, ABS_MT_TRACKING_ID);
+	if (id < 0 || input_mt_get_value(slot, ABS_MT_TOOL_TYPE) != (int)tool_type)
+		id = input_mt_new_trkid(mt);
+
+	input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, id);
+	input_event(dev, EV_ABS, ABS_MT_TOOL_TYPE, tool_type);
+
+	return true;
+}
+
+static inline void input_mt_report_finger_count(struct input_dev *dev,
+						int count)
+{
+	input_event(dev, EV_KEY, BTN_TOOL_FINGER, count == 1);
+	input_event(dev, EV_KEY, BTN_TOOL_DOUBLETAP, count == 2);
+	input_event(dev, EV_KEY, BTN_TOOL_TRIPLETAP, count == 3);
+	input_event(dev, EV_KEY, BTN_TOOL_QUADTAP, count == 4);
+	input_event(dev, EV_KEY, BTN_TOOL_QUINTTAP, count == 5);
+}
+
+static inline void input_mt_report_pointer_emulation(struct input_dev *dev,
+						     bool use_count)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *oldest = NULL;
+	int oldid = mt->trkid;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < mt->num_slots; ++i) {
+		struct input_mt_slot *ps = &mt->slots[i];
+		int id = input_mt_get_value(ps, ABS_MT_TRACKING_ID);
+
+		if (id < 0)
+			continue;
+		if ((id - oldid) & ((TRKID_MAX + 1) >> 1)) {
+			oldest = ps;
+			oldid = id;
+		}
+		count++;
+	}
+
+	input_event(dev, EV_KEY, BTN_TOUCH, count > 0);
+	if (use_count)
+		input_mt_report_finger_count(dev, count);
+
+	if (oldest) {
+		input_event(dev, EV_ABS, ABS_X,
+			    input_mt_get_value(oldest, ABS_MT_POSITION_X));
+		input_event(dev, EV_ABS, ABS_Y,
+			    input_mt_get_value(oldest, ABS_MT_POSITION_Y));
+		if (test_bit(ABS_MT_PRESSURE, dev->absbit))
+			input_event(dev, EV_ABS, ABS_PRESSURE,
+				    input_mt_get_value(oldest, ABS_MT_PRESSURE));
+	} else if (test_bit(ABS_MT_PRESSURE, dev->absbit)) {
+		input_event(dev, EV_ABS, ABS_PRESSURE, 0);
+	}
+}
+
+static inline void input_mt_sync_frame(struct input_dev *dev)
+{
+	struct input_mt *mt = dev->mt;
+
+	if (!mt)
+		return;
+
+	if (mt->flags & INPUT_MT_POINTER)
+		input_mt_report_pointer_emulation(dev, true);
+
+	mt->frame++;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SHIM_LINUX_MODULE_H
+#define SHIM_LINUX_MODULE_H
+
+#include "../shim.h"
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DEVICE_TABLE(type, name)
+#define MODULE_PARM_DESC(name, desc)
+
+#define module_param(name, type, perm)
+
+#endif
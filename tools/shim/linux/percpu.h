@@ -0,0 +1,18 @@
+#ifndef SHIM_LINUX_PERCPU_H
+#define SHIM_LINUX_PERCPU_H
+
+#include "../shim.h"
+
+/* the bench is single threaded, so there is exactly one CPU */
+#define __percpu
+
+#define alloc_percpu(type)		((type *)calloc(1, sizeof(type)))
+#define devm_alloc_percpu(dev, type)	((void)(dev), alloc_percpu(type))
+#define free_percpu(ptr)		free(ptr)
+#define per_cpu_ptr(ptr, cpu)		((void)(cpu), (ptr))
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+#define this_cpu_add(var, val)		((var) += (val))
+#define this_cpu_inc(var)		this_cpu_add(var, 1)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SHIM_LINUX_TRACEPOINT_H
+#define SHIM_LINUX_TRACEPOINT_H
+
+#include "../shim.h"
+
+/* tracepoints compile to nothing, the bench measures the untraced path */
+#define PARAMS(args...)		args
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+
+#define TRACE_EVENT(name, proto, args, struct, assign, print)		\
+	static inline void trace_##name(proto) {}			\
+	static inline bool trace_##name##_enabled(void) { return false; }
+
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+
+#define DEFINE_EVENT(template, name, proto, args)			\
+	static inline void trace_##name(proto) {}			\
+	static inline bool trace_##name##_enabled(void) { return false; }
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef SHIM_LINUX_VERSION_H
+#define SHIM_LINUX_VERSION_H
+
+/* the shims model a current kernel, not the one of the build host */
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + ((c) > 255 ? 255 : (c)))
+#define LINUX_VERSION_CODE	KERNEL_VERSION(6, 1, 0)
+
+#endif
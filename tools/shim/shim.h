@@ -0,0 +1,153 @@
+/*
+ * Minimal kernel environment for building driver code in userspace.
+ *
+ * Only what src/hid-asus.c needs is provided, with the same semantics
+ * as the kernel where it matters for the decode path.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#ifndef SHIM_H_FILE
+#define SHIM_H_FILE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+/* u64 is unsigned long long on every kernel arch, formats rely on it */
+typedef unsigned long long u64;
+typedef long long s64;
+
+#define BIT(nr)			(1UL << (nr))
+#define BITS_PER_LONG		(8 * sizeof(long))
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+#define __maybe_unused		__attribute__((unused))
+#define __always_unused		__attribute__((unused))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define GFP_KERNEL		0
+
+typedef s64 ktime_t;
+
+static inline ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline s64 ktime_to_us(ktime_t kt)
+{
+	return kt / 1000;
+}
+
+static inline void __set_bit(int nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline void __clear_bit(int nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+
+static inline bool test_bit(int nr, const unsigned long *addr)
+{
+	return addr[nr / BITS_PER_LONG] & (1UL << (nr % BITS_PER_LONG));
+}
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+struct kobject {
+	const char *name;
+};
+
+struct device {
+	const char *name;
+	struct kobject kobj;
+};
+
+/* sysfs files are never created, only the attribute tables are built */
+struct attribute {
+	const char *name;
+	unsigned short mode;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+#define __ATTR(_name, _mode, _show, _store) {				\
+	.attr = { .name = #_name, .mode = (_mode) },			\
+	.show = (_show),						\
+	.store = (_store),						\
+}
+
+struct attribute_group {
+	const char *name;
+	struct attribute **attrs;
+};
+
+static inline int sysfs_create_group(struct kobject *kobj,
+				     const struct attribute_group *grp)
+{
+	(void)kobj;
+	(void)grp;
+	return 0;
+}
+
+static inline void sysfs_remove_group(struct kobject *kobj,
+				      const struct attribute_group *grp)
+{
+	(void)kobj;
+	(void)grp;
+}
+
+static inline void *kzalloc(size_t size, int gfp)
+{
+	(void)gfp;
+	return calloc(1, size);
+}
+
+static inline void *devm_kzalloc(struct device *dev, size_t size, int gfp)
+{
+	(void)dev;
+	return kzalloc(size, gfp);
+}
+
+static inline void *kmemdup(const void *src, size_t len, int gfp)
+{
+	void *p = malloc(len);
+
+	(void)gfp;
+	if (p)
+		memcpy(p, src, len);
+	return p;
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+#endif
@@ -0,0 +1 @@
+/* nothing to instantiate, see shim/linux/tracepoint.h */